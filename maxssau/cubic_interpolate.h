@@ -1,31 +1,264 @@
 #ifndef __cubic__interpolation__
 #define __cubic__interpolation__
 
+#include <cmath>
+#include <limits>
+#include <type_traits>
 #include <vector>
 #include <stdexcept>
 #include <algorithm>
 
+#include "minmax.h"
+#include "parallel.h"
+
 namespace maxssau
 {
 
+	// Размещение коэффициентов сплайна в памяти
+	enum CoefficientLayout
+	{
+		LayoutPacked=0,	// узел и четыре коэффициента интервала в одной выровненной структуре
+		LayoutSoA=1		// дополнительно отдельные массивы коэффициентов для векторной выборки
+	};
+
+	// Вид сплайна (граничные условия или способ выбора производных в узлах)
+	enum SplineType
+	{
+		SplineNatural=0,	// вторая производная на концах = 0
+		SplineClamped=1,	// заданные первые производные на концах
+		SplineNotAKnot=2,	// третья производная непрерывна во втором и предпоследнем узлах
+		SplinePeriodic=3,	// периодический, требует y_0 = y_n
+		SplineMonotone=4,	// PCHIP (Fritsch-Carlson): монотонный, без выбросов
+		SplineAkima=5		// Akima: устойчив к выбросам, без глобальной системы
+	};
+
+	// Поведение CubicEvaluator за пределами диапазона узлов
+	enum ExtrapolationMode
+	{
+		ExtrapolateClamp=0,		// значение в ближайшем крайнем узле
+		ExtrapolateLinear=1,	// касательная в крайнем узле
+		ExtrapolateConstant=2	// заданное значение (например, 0 или NaN)
+	};
+
+	// Преобразование к выходному типу: для целых типов округление и ограничение диапазоном
+	template <typename TypeOut, typename T>
+	inline TypeOut saturateCast(T value) {
+		if (std::is_integral<TypeOut>::value) {
+			T rounded = std::round(value);
+			
+			if (!(rounded > T(std::numeric_limits<TypeOut>::lowest()))) {
+				return std::numeric_limits<TypeOut>::lowest();
+			}
+			if (rounded >= T(std::numeric_limits<TypeOut>::max())) {
+				return std::numeric_limits<TypeOut>::max();
+			}
+			return TypeOut(rounded);
+		}
+		
+		return TypeOut(value);
+	}
+	
+	// Интервал сплайна: узел и коэффициенты полинома a + b*dx + c*dx^2 + d*dx^3.
+	// Выравнивание на 8 элементов (64 байта для double) - интервал занимает
+	// ровно одну строку кэша, поиск и вычисление читают только её
+	template <typename T>
+	struct alignas(8 * sizeof(T) < 64 ? 8 * sizeof(T) : 64) CubicSegment {
+		T x;
+		T a;
+		T b;
+		T c;
+		T d;
+		
+		// Схема Горнера
+		T evaluate(T value) const noexcept {
+			T dx = value - x;
+			
+			return a + dx * (b + dx * (c + dx * d));
+		}
+	};
+	
+	// Индекс для поиска интервала за O(1), общий для CubicInterpolator и CubicEvaluator:
+	// равномерные участки сетки либо (для нерегулярной сетки) корзины с номером первого интервала.
+	// Интервалы - n - 1 первых элементов segments, последний элемент - граничный узел
+	template <typename T>
+	class CubicIntervalIndex {
+	public:
+		typedef CubicSegment<T> Segment;
+		
+		CubicIntervalIndex() : bucket_origin(0), bucket_inverse_step(0) {}
+		
+		// Разбиение узлов на равномерные участки; если их немного, номер интервала
+		// вычисляется напрямую, иначе строится индекс корзин по всему диапазону
+		void build(const std::vector<Segment>& segments) {
+			size_t intervals = segments.size() - 1;
+			
+			grid_pieces.clear();
+			bucket_index.clear();
+			
+			for (size_t first = 0; first < intervals && grid_pieces.size() <= max_grid_pieces; ) {
+				T step = segments[first + 1].x - segments[first].x;
+				T tolerance = step * T(1e-4);
+				size_t last = first;
+				
+				while (last + 1 < intervals &&
+					std::abs(segments[last + 2].x - segments[first].x - step * T(last + 2 - first)) <= tolerance) {
+					++last;
+				}
+				
+				grid_pieces.push_back({segments[first].x, T(1) / step, first, last});
+				first = last + 1;
+			}
+			
+			if (grid_pieces.size() <= max_grid_pieces) {
+				return;
+			}
+			
+			grid_pieces.clear();
+			
+			T bucket_step = (segments.back().x - segments.front().x) / T(intervals);
+			
+			bucket_origin = segments.front().x;
+			bucket_inverse_step = T(1) / bucket_step;
+			bucket_index.resize(intervals);
+			
+			size_t idx = 0;
+			for (size_t b = 0; b < intervals; ++b) {
+				T bucket_start = bucket_origin + bucket_step * T(b);
+				
+				while (idx + 1 < intervals && segments[idx + 1].x <= bucket_start) {
+					++idx;
+				}
+				bucket_index[b] = idx;
+			}
+		}
+		
+		// Интервал [x_i, x_{i+1}], содержащий x (x внутри диапазона)
+		size_t find(const std::vector<Segment>& segments, T x) const noexcept {
+			size_t last = segments.size() - 2;
+			size_t idx;
+			
+			if (!grid_pieces.empty()) {
+				size_t p = 0;
+				while (p + 1 < grid_pieces.size() && x >= segments[grid_pieces[p + 1].first].x) {
+					++p;
+				}
+				
+				const GridPiece& piece = grid_pieces[p];
+				T position = (x - piece.origin) * piece.inverse_step;
+				
+				idx = piece.first + (position > T(0) ? std::min(size_t(position), piece.last - piece.first) : 0);
+			}
+			else {
+				T position = (x - bucket_origin) * bucket_inverse_step;
+				
+				idx = bucket_index[position > T(0) ? std::min(size_t(position), last) : 0];
+				
+				while (idx < last && x >= segments[idx + 1].x) {
+					++idx;
+				}
+			}
+			
+			// Поправка на ошибки округления
+			if (idx > 0 && x < segments[idx].x) {
+				--idx;
+			}
+			else if (idx < last && x >= segments[idx + 1].x) {
+				++idx;
+			}
+			
+			return idx;
+		}
+		
+		// Поиск от интервала предыдущей точки: для монотонных входов это
+		// проверка текущего интервала и несколько шагов вперёд вместо бинарного поиска
+		size_t find(const std::vector<Segment>& segments, T x, size_t hint) const noexcept {
+			size_t last = segments.size() - 2;
+			
+			if (x >= segments[hint].x) {
+				for (int step = 0; step < 4; ++step) {
+					if (hint == last || x < segments[hint + 1].x) {
+						return hint;
+					}
+					++hint;
+				}
+			}
+			
+			return find(segments, x);
+		}
+		
+	private:
+		// Участок сетки с постоянным шагом: интервалы [first, last]
+		struct GridPiece {
+			T origin;
+			T inverse_step;
+			size_t first;
+			size_t last;
+		};
+		
+		// Не более стольких равномерных участков, иначе используются корзины
+		static constexpr size_t max_grid_pieces = 8;
+		
+		std::vector<GridPiece> grid_pieces;
+		std::vector<size_t> bucket_index;
+		T bucket_origin;
+		T bucket_inverse_step;
+	};
+	
+	template <typename T>
+	class CubicEvaluator;
+
 	template <typename T>
 	class CubicInterpolator {
 	private:
 		std::vector<T> x_values;  // Узлы интерполяции
 		std::vector<T> y_values;  // Значения функции в узлах
 		
-		// Коэффициенты для кубических полиномов между узлами
-		std::vector<std::array<T, 4>> coefficients;
+		typedef CubicSegment<T> Segment;
+		
+		// Коэффициенты для кубических полиномов между узлами,
+		// последний элемент - граничный узел x_n (только для поиска)
+		std::vector<Segment> segments;
+		
+		// Раздельные массивы коэффициентов (LayoutSoA)
+		CoefficientLayout layout;
+		std::vector<T> soa_a;
+		std::vector<T> soa_b;
+		std::vector<T> soa_c;
+		std::vector<T> soa_d;
 		
 		// Флаг, указывающий, были ли вычислены коэффициенты
 		bool coefficients_calculated;
 		
+		// Вид сплайна и производные на концах для SplineClamped
+		SplineType spline_type;
+		T first_derivative;
+		T last_derivative;
+		
+		// Индекс для поиска интервала за O(1)
+		CubicIntervalIndex<T> interval_index;
+		
+		// Инкрементальный режим: накопленные точки и ширина окна локального пересчёта
+		bool incremental;
+		size_t incremental_batch;
+		std::vector<std::pair<T, T>> pending_points;
+		static constexpr size_t incremental_window = 32;
+		
+		// Таблица значений сплайна на равномерной сетке (табличный режим)
+		std::vector<T> lut_values;
+		T lut_origin;
+		T lut_scale;
+		bool lut_linear;
+		
 	public:
-		CubicInterpolator() : coefficients_calculated(false) {}
+		CubicInterpolator() : layout(LayoutPacked), coefficients_calculated(false),
+			spline_type(SplineNatural), first_derivative(0), last_derivative(0),
+			incremental(false), incremental_batch(1), lut_origin(0), lut_scale(0), lut_linear(false) {}
 		
 		// Конструктор с передачей данных
 		CubicInterpolator(const std::vector<T>& x, const std::vector<T>& y) 
-			: x_values(x), y_values(y), coefficients_calculated(false) 
+			: x_values(x), y_values(y), layout(LayoutPacked), coefficients_calculated(false),
+			spline_type(SplineNatural), first_derivative(0), last_derivative(0),
+			incremental(false), incremental_batch(1), lut_origin(0), lut_scale(0), lut_linear(false)
 		{
 			if (x.size() != y.size()) {
 				throw std::invalid_argument("x and y arrays must have the same size");
@@ -37,6 +270,17 @@ namespace maxssau
 		
 		// Добавление точки
 		void addPoint(T x, T y) {
+			lut_values.clear();
+			
+			if (incremental) {
+				pending_points.push_back({x, y});
+				
+				if (pending_points.size() >= incremental_batch) {
+					flushPoints();
+				}
+				return;
+			}
+			
 			// Находим позицию для вставки, чтобы сохранить порядок по x
 			auto it = std::lower_bound(x_values.begin(), x_values.end(), x);
 			size_t pos = it - x_values.begin();
@@ -47,6 +291,39 @@ namespace maxssau
 			coefficients_calculated = false;
 		}
 		
+		// Инкрементальный режим: addPoint накапливает до batch_size точек, затем они
+		// вливаются в узлы одним проходом, а вторые производные пересчитываются только
+		// в окне из incremental_window узлов вокруг каждой новой точки.
+		// Сложность вливания - O(n + batch_size * incremental_window): сдвиг узлов правее
+		// первой новой точки, раскладка и индекс интервалов по-прежнему строятся за O(n),
+		// экономится только прогонка по всем узлам. В среднем точка стоит
+		// O(n / batch_size + incremental_window), при batch_size = 1 - те же O(n), что и перестроение.
+		// Окно - приближение: влияние точки на естественный сплайн затухает в (2 - sqrt(3)) ~ 0.27
+		// раза на узел только на равномерной сетке (за 32 узла - ниже точности double);
+		// на неравномерной сетке затухание медленнее, отличие от полного пересчёта
+		// (на сетке с шагами от e^-3 до e^3 - порядка 1e-13 относительно значений) не равно нулю
+		void setIncrementalMode(bool enabled, size_t batch_size = 64) {
+			flushPoints();
+			incremental = enabled;
+			incremental_batch = batch_size == 0 ? 1 : batch_size;
+		}
+		
+		bool isIncrementalMode() const {
+			return incremental;
+		}
+		
+		// Вливание накопленных точек (вызывается автоматически перед интерполяцией)
+		void flushPoints() {
+			if (pending_points.empty()) {
+				return;
+			}
+			
+			bool local = coefficients_calculated && spline_type == SplineNatural &&
+				pending_points.size() * 2 * incremental_window < x_values.size();
+			
+			mergePendingPoints(local);
+		}
+		
 		// Установка всех точек
 		void setPoints(const std::vector<T>& x, const std::vector<T>& y) {
 			if (x.size() != y.size()) {
@@ -58,13 +335,24 @@ namespace maxssau
 			
 			x_values = x;
 			y_values = y;
+			pending_points.clear();
 			coefficients_calculated = false;
+			lut_values.clear();
 		}
 		
 		// Вычисление коэффициентов кубических полиномов
 		void calculateCoefficients() {
+			if (!pending_points.empty()) {
+				mergePendingPoints(false);
+			}
+			
+			if (spline_type != SplineNatural) {
+				setHermiteSegments(calculateSlopes());
+				return;
+			}
+			
 			size_t n = x_values.size();
-			coefficients.resize(n - 1);
+			segments.resize(n);
 			
 			// Для простоты используем естественные граничные условия (вторая производная на концах = 0)
 			// В реальных реализациях можно использовать другие граничные условия
@@ -116,45 +404,847 @@ namespace maxssau
 			
 			// Сохраняем коэффициенты
 			for (size_t i = 0; i < n - 1; ++i) {
-				coefficients[i] = {y_values[i], b[i], c[i], d[i]};
+				segments[i] = {x_values[i], y_values[i], b[i], c[i], d[i]};
 			}
+			segments[n - 1] = {x_values[n - 1], y_values[n - 1], T(0), T(0), T(0)};
+			
+			buildLayout();
+			
+			buildIntervalIndex();
 			
 			coefficients_calculated = true;
 		}
 		
+		// Число узлов, включая накопленные в инкрементальном режиме
+		size_t getPointsCount() const {
+			return x_values.size() + pending_points.size();
+		}
+		
+		// Выбор вида сплайна; для SplineClamped производные на концах задаются отдельно
+		void setSplineType(SplineType type) {
+			flushPoints();
+			spline_type = type;
+			coefficients_calculated = false;
+			lut_values.clear();
+		}
+		
+		SplineType getSplineType() const {
+			return spline_type;
+		}
+		
+		void setBoundaryDerivatives(T first, T last) {
+			first_derivative = first;
+			last_derivative = last;
+			
+			if (spline_type == SplineClamped) {
+				coefficients_calculated = false;
+				lut_values.clear();
+			}
+		}
+		
 		// Интерполяция значения в точке x
 		T interpolate(T x) {
-			if (!coefficients_calculated) {
-				calculateCoefficients();
-			}
+			prepare();
 			
 			// Проверяем границы
 			if (x < x_values.front() || x > x_values.back()) {
 				throw std::out_of_range("x is out of interpolation range");
 			}
 			
-			// Находим интервал, в который попадает x
-			auto it = std::upper_bound(x_values.begin(), x_values.end(), x);
-			size_t idx = std::distance(x_values.begin(), it) - 1;
+			return evaluate(findInterval(x), x);
+		}
+		
+		// Пакетная интерполяция: ys[i] = f(xs[i]), i < n
+		// Для отсортированных (или почти отсортированных) xs интервал ищется от предыдущего,
+		// а не бинарным поиском; threads > 1 делит массив между потоками (0 - все ядра)
+		void interpolate(const T* xs, T* ys, size_t n, unsigned int threads = 1) {
+			if (n == 0) {
+				return;
+			}
+			
+			prepare();
+			
+			// Проверяем границы до записи результата, как и в скалярной версии
+			MinMax<T> range;
+			range.Calculate(xs, n, threads);
+			if (range.GetMinValue() < x_values.front() || range.GetMaxValue() > x_values.back()) {
+				throw std::out_of_range("x is out of interpolation range");
+			}
+			
+			threads = GetThreadsCount(n, threads, 1 << 14);
+			
+			ParallelFor(n, threads, [&](size_t begin, size_t end, unsigned int) {
+				interpolateRange(xs + begin, ys + begin, end - begin);
+			});
+		}
+		
+		void interpolate(const std::vector<T>& xs, std::vector<T>& ys, unsigned int threads = 1) {
+			ys.resize(xs.size());
+			interpolate(xs.data(), ys.data(), xs.size(), threads);
+		}
+		
+		// Табличный режим: сплайн сэмплируется на равномерную сетку из table_size узлов
+		// по всему диапазону x, затем значение берётся из таблицы - ближайший узел
+		// или линейная интерполяция между соседними узлами (linear_refinement)
+		void compileLookupTable(size_t table_size, bool linear_refinement = true) {
+			if (table_size < 2) {
+				throw std::invalid_argument("Lookup table must have at least 2 entries");
+			}
+			
+			prepare();
+			
+			T x_first = x_values.front();
+			T x_last = x_values.back();
+			
+			std::vector<T> grid(table_size);
+			for (size_t i = 0; i < table_size; ++i) {
+				grid[i] = x_first + (x_last - x_first) * i / (table_size - 1);
+			}
+			grid.back() = x_last;
+			
+			lut_values.resize(table_size);
+			interpolateRange(grid.data(), lut_values.data(), table_size);
+			
+			lut_origin = x_first;
+			lut_scale = (table_size - 1) / (x_last - x_first);
+			lut_linear = linear_refinement;
+		}
+		
+		bool isLookupTableCompiled() const {
+			return !lut_values.empty();
+		}
+		
+		// Значение из таблицы; x за пределами диапазона ограничивается крайними узлами
+		T interpolateLookupTable(T x) const {
+			if (lut_values.empty()) {
+				throw std::logic_error("Lookup table is not compiled");
+			}
+			
+			return lookupTable(x);
+		}
+		
+		void interpolateLookupTable(const T* xs, T* ys, size_t n, unsigned int threads = 1) const {
+			if (lut_values.empty()) {
+				throw std::logic_error("Lookup table is not compiled");
+			}
+			
+			threads = GetThreadsCount(n, threads, 1 << 16);
+			
+			ParallelFor(n, threads, [&](size_t begin, size_t end, unsigned int) {
+				for (size_t i = begin; i < end; ++i) {
+					ys[i] = lookupTable(xs[i]);
+				}
+			});
+		}
+		
+		// Таблица для целочисленного входа с разрядностью bits: entry[i] = f(i * input_scale) * output_scale.
+		// Аргумент ограничивается диапазоном узлов, для целых TypeOut результат
+		// округляется и ограничивается диапазоном типа
+		template <typename TypeOut>
+		std::vector<TypeOut> buildIntegerTable(unsigned int bits, T input_scale = T(1), T output_scale = T(1)) {
+			if (bits == 0 || bits > 24) {
+				throw std::invalid_argument("Integer table must have from 1 to 24 bits");
+			}
+			
+			prepare();
 			
-			// Если x совпадает с последним узлом
-			if (idx >= x_values.size() - 1) {
-				idx = x_values.size() - 2;
+			size_t size = size_t(1) << bits;
+			std::vector<T> xs(size);
+			std::vector<T> ys(size);
+			
+			for (size_t i = 0; i < size; ++i) {
+				T x = T(i) * input_scale;
+				xs[i] = std::min(std::max(x, x_values.front()), x_values.back());
+			}
+			
+			interpolateRange(xs.data(), ys.data(), size);
+			
+			std::vector<TypeOut> table(size);
+			for (size_t i = 0; i < size; ++i) {
+				table[i] = saturateCast<TypeOut>(ys[i] * output_scale);
 			}
 			
-			// Вычисляем значение кубического полинома
-			T dx = x - x_values[idx];
-			const auto& coef = coefficients[idx];
+			return table;
+		}
+		
+		// Неизменяемый вычислитель для рабочих циклов: коэффициенты вычисляются здесь,
+		// дальнейшие изменения интерполятора на него не влияют
+		CubicEvaluator<T> compile(ExtrapolationMode mode = ExtrapolateClamp, T fill_value = T(0)) {
+			prepare();
+			
+			return CubicEvaluator<T>(segments, interval_index, mode, fill_value);
+		}
+		
+		// Первые производные сплайна в узлах (для построения многомерных сплайнов)
+		std::vector<T> getKnotDerivatives() {
+			prepare();
+			
+			size_t n = x_values.size();
+			std::vector<T> derivatives(n);
 			
-			return coef[0] + coef[1] * dx + coef[2] * dx * dx + coef[3] * dx * dx * dx;
+			for (size_t i = 0; i < n - 1; ++i) {
+				derivatives[i] = segments[i].b;
+			}
+			
+			const Segment& last = segments[n - 2];
+			T h = x_values[n - 1] - x_values[n - 2];
+			derivatives[n - 1] = last.b + h * (2.0 * last.c + 3.0 * h * last.d);
+			
+			return derivatives;
+		}
+		
+		// Выбор размещения коэффициентов; LayoutSoA использует пакетная интерполяция
+		void setLayout(CoefficientLayout new_layout) {
+			layout = new_layout;
+			
+			if (coefficients_calculated) {
+				buildLayout();
+			}
+		}
+		
+		CoefficientLayout getLayout() const {
+			return layout;
 		}
 		
 		// Очистка данных
 		void clear() {
 			x_values.clear();
 			y_values.clear();
-			coefficients.clear();
+			pending_points.clear();
+			segments.clear();
+			soa_a.clear();
+			soa_b.clear();
+			soa_c.clear();
+			soa_d.clear();
 			coefficients_calculated = false;
+			lut_values.clear();
+		}
+		
+	private:
+		// Размер блока пакетной интерполяции: индексы интервалов блока помещаются в L1
+		static constexpr size_t batch_block = 256;
+		
+		void prepare() {
+			if (!pending_points.empty()) {
+				flushPoints();
+			}
+			
+			if (!coefficients_calculated) {
+				calculateCoefficients();
+			}
+		}
+		
+		// Слияние накопленных точек с узлами за один проход, O(n). При update_coefficients
+		// старые интервалы копируются, а система для вторых производных решается
+		// только в окнах вокруг новых узлов с закреплёнными значениями на краях окна
+		// (приближение, см. setIncrementalMode)
+		void mergePendingPoints(bool update_coefficients) {
+			std::stable_sort(pending_points.begin(), pending_points.end(),
+				[](const std::pair<T, T>& a, const std::pair<T, T>& b) { return a.first < b.first; });
+			
+			size_t n_old = x_values.size();
+			size_t n = n_old + pending_points.size();
+			std::vector<size_t> inserted;
+			
+			x_values.resize(n);
+			y_values.resize(n);
+			
+			if (update_coefficients) {
+				segments.resize(n);
+				inserted.reserve(pending_points.size());
+			}
+			
+			// Слияние с конца на месте: сдвигаются только узлы правее первой новой точки;
+			// как и addPoint, новая точка встаёт перед равными ей узлами
+			for (size_t i = n_old, j = pending_points.size(), k = n; j > 0; --k) {
+				if (i == 0 || pending_points[j - 1].first > x_values[i - 1]) {
+					--j;
+					x_values[k - 1] = pending_points[j].first;
+					y_values[k - 1] = pending_points[j].second;
+					
+					if (update_coefficients) {
+						segments[k - 1] = {x_values[k - 1], y_values[k - 1], T(0), T(0), T(0)};
+						inserted.push_back(k - 1);
+					}
+				}
+				else {
+					--i;
+					x_values[k - 1] = x_values[i];
+					y_values[k - 1] = y_values[i];
+					
+					if (update_coefficients) {
+						segments[k - 1] = segments[i];
+					}
+				}
+			}
+			
+			pending_points.clear();
+			lut_values.clear();
+			
+			if (!update_coefficients) {
+				coefficients_calculated = false;
+				return;
+			}
+			
+			std::reverse(inserted.begin(), inserted.end());
+			
+			// Окна вокруг новых узлов; c_0 = c_{n-1} = 0 (естественные граничные условия)
+			size_t lo = 0;
+			size_t hi = 0;
+			bool open = false;
+			
+			for (size_t k : inserted) {
+				size_t window_lo = std::max<size_t>(1, k > incremental_window ? k - incremental_window : 0);
+				size_t window_hi = std::min(n - 2, k + incremental_window);
+				
+				if (open && window_lo <= hi + 1) {
+					hi = std::max(hi, window_hi);
+					continue;
+				}
+				
+				if (open) {
+					updateRange(lo, hi);
+				}
+				
+				lo = window_lo;
+				hi = window_hi;
+				open = true;
+			}
+			
+			if (open) {
+				updateRange(lo, hi);
+			}
+			
+			segments[0].c = T(0);
+			segments[n - 1] = {x_values[n - 1], y_values[n - 1], T(0), T(0), T(0)};
+			
+			// интервалы у первого и последнего узла могли измениться при вставке на краях
+			updateSegment(0);
+			updateSegment(n - 2);
+			
+			buildLayout();
+			buildIntervalIndex();
+		}
+		
+		// Прогонка для c_lo..c_hi при известных c_{lo-1} и c_{hi+1}, затем пересчёт b, d
+		void updateRange(size_t lo, size_t hi) {
+			if (lo > hi) {
+				return;
+			}
+			
+			size_t count = hi - lo + 1;
+			std::vector<T> upper(count);
+			std::vector<T> rhs(count);
+			
+			for (size_t k = 0; k < count; ++k) {
+				size_t i = lo + k;
+				T h_prev = x_values[i] - x_values[i - 1];
+				T h = x_values[i + 1] - x_values[i];
+				T diagonal = 2.0 * (h_prev + h);
+				T value = 3.0 / h * (y_values[i + 1] - y_values[i]) - 3.0 / h_prev * (y_values[i] - y_values[i - 1]);
+				
+				if (k == 0) {
+					value -= h_prev * segments[i - 1].c;
+				}
+				else {
+					T factor = h_prev;
+					diagonal -= factor * upper[k - 1];
+					value -= factor * rhs[k - 1];
+				}
+				
+				if (k == count - 1) {
+					value -= h * segments[i + 1].c;
+				}
+				
+				upper[k] = h / diagonal;
+				rhs[k] = value / diagonal;
+			}
+			
+			segments[hi].c = rhs[count - 1];
+			for (size_t k = count - 1; k > 0; --k) {
+				segments[lo + k - 1].c = rhs[k - 1] - upper[k - 1] * segments[lo + k].c;
+			}
+			
+			for (size_t i = lo - 1; i <= hi; ++i) {
+				updateSegment(i);
+			}
+		}
+		
+		void updateSegment(size_t i) {
+			T h = x_values[i + 1] - x_values[i];
+			Segment& segment = segments[i];
+			
+			segment.x = x_values[i];
+			segment.a = y_values[i];
+			segment.b = (y_values[i + 1] - y_values[i]) / h - h * (segments[i + 1].c + 2.0 * segment.c) / 3.0;
+			segment.d = (segments[i + 1].c - segment.c) / (3.0 * h);
+		}
+		
+		// Первые производные в узлах для всех видов сплайна, кроме естественного
+		std::vector<T> calculateSlopes() const {
+			size_t n = x_values.size();
+			std::vector<T> h(n - 1);
+			std::vector<T> delta(n - 1);
+			std::vector<T> m(n);
+			
+			for (size_t i = 0; i < n - 1; ++i) {
+				h[i] = x_values[i + 1] - x_values[i];
+				delta[i] = (y_values[i + 1] - y_values[i]) / h[i];
+			}
+			
+			if (spline_type == SplinePeriodic && y_values.front() != y_values.back()) {
+				throw std::invalid_argument("Periodic spline requires equal first and last values");
+			}
+			
+			// Два узла: прямая (или заданные производные)
+			if (n == 2) {
+				m[0] = spline_type == SplineClamped ? first_derivative : delta[0];
+				m[1] = spline_type == SplineClamped ? last_derivative : delta[0];
+				if (spline_type == SplinePeriodic) {
+					m[0] = m[1] = T(0);
+				}
+				return m;
+			}
+			
+			switch (spline_type) {
+			case SplineMonotone:
+				calculateMonotoneSlopes(h, delta, m);
+				return m;
+				
+			case SplineAkima:
+				calculateAkimaSlopes(delta, m);
+				return m;
+				
+			case SplinePeriodic:
+				calculatePeriodicSlopes(h, delta, m);
+				return m;
+				
+			default:
+				break;
+			}
+			
+			// Не-узел на трёх точках - одна парабола
+			if (spline_type == SplineNotAKnot && n == 3) {
+				T curvature = (delta[1] - delta[0]) / (h[0] + h[1]);
+				m[0] = delta[0] - curvature * h[0];
+				m[1] = delta[0] + curvature * h[0];
+				m[2] = delta[1] + curvature * h[1];
+				return m;
+			}
+			
+			// Трёхдиагональная система для производных:
+			// h_i m_{i-1} + 2(h_{i-1} + h_i) m_i + h_{i-1} m_{i+1} = 3(h_i delta_{i-1} + h_{i-1} delta_i)
+			std::vector<T> lower(n, T(0));
+			std::vector<T> diagonal(n);
+			std::vector<T> upper(n, T(0));
+			
+			for (size_t i = 1; i < n - 1; ++i) {
+				lower[i] = h[i];
+				diagonal[i] = 2.0 * (h[i - 1] + h[i]);
+				upper[i] = h[i - 1];
+				m[i] = 3.0 * (h[i] * delta[i - 1] + h[i - 1] * delta[i]);
+			}
+			
+			if (spline_type == SplineClamped) {
+				diagonal[0] = T(1);
+				m[0] = first_derivative;
+				diagonal[n - 1] = T(1);
+				m[n - 1] = last_derivative;
+			}
+			else {
+				T d = h[0] + h[1];
+				diagonal[0] = h[1];
+				upper[0] = d;
+				m[0] = ((h[0] + 2.0 * d) * h[1] * delta[0] + h[0] * h[0] * delta[1]) / d;
+				
+				d = h[n - 3] + h[n - 2];
+				diagonal[n - 1] = h[n - 3];
+				lower[n - 1] = d;
+				m[n - 1] = (h[n - 2] * h[n - 2] * delta[n - 3] + (2.0 * d + h[n - 2]) * h[n - 3] * delta[n - 2]) / d;
+			}
+			
+			solveTridiagonal(lower, diagonal, upper, m);
+			
+			return m;
+		}
+		
+		// PCHIP: во внутренних узлах взвешенное гармоническое среднее наклонов
+		// (0 в экстремумах), на концах трёхточечная формула с ограничением
+		static void calculateMonotoneSlopes(const std::vector<T>& h, const std::vector<T>& delta, std::vector<T>& m) {
+			size_t n = m.size();
+			
+			for (size_t i = 1; i < n - 1; ++i) {
+				if (delta[i - 1] * delta[i] <= T(0)) {
+					m[i] = T(0);
+					continue;
+				}
+				
+				T w1 = 2.0 * h[i] + h[i - 1];
+				T w2 = h[i] + 2.0 * h[i - 1];
+				m[i] = (w1 + w2) / (w1 / delta[i - 1] + w2 / delta[i]);
+			}
+			
+			m[0] = monotoneEndSlope(h[0], h[1], delta[0], delta[1]);
+			m[n - 1] = monotoneEndSlope(h[n - 2], h[n - 3], delta[n - 2], delta[n - 3]);
+		}
+		
+		static T monotoneEndSlope(T h0, T h1, T delta0, T delta1) {
+			T slope = ((2.0 * h0 + h1) * delta0 - h0 * delta1) / (h0 + h1);
+			
+			if ((slope > T(0)) != (delta0 > T(0)) || delta0 == T(0)) {
+				return T(0);
+			}
+			
+			if ((delta0 > T(0)) != (delta1 > T(0)) && std::abs(slope) > std::abs(3.0 * delta0)) {
+				return 3.0 * delta0;
+			}
+			
+			return slope;
+		}
+		
+		// Akima: наклоны по соседним разностям, по два фиктивных интервала на каждом конце
+		static void calculateAkimaSlopes(const std::vector<T>& delta, std::vector<T>& m) {
+			size_t n = m.size();
+			std::vector<T> d(n + 3);
+			
+			for (size_t i = 0; i < n - 1; ++i) {
+				d[i + 2] = delta[i];
+			}
+			
+			d[1] = 2.0 * d[2] - d[3];
+			d[0] = 2.0 * d[1] - d[2];
+			d[n + 1] = 2.0 * d[n] - d[n - 1];
+			d[n + 2] = 2.0 * d[n + 1] - d[n];
+			
+			for (size_t i = 0; i < n; ++i) {
+				T w1 = std::abs(d[i + 3] - d[i + 2]);
+				T w2 = std::abs(d[i + 1] - d[i]);
+				
+				if (w1 + w2 == T(0)) {
+					m[i] = 0.5 * (d[i + 1] + d[i + 2]);
+				}
+				else {
+					m[i] = (w1 * d[i + 1] + w2 * d[i + 2]) / (w1 + w2);
+				}
+			}
+		}
+		
+		// Периодический сплайн: циклическая трёхдиагональная система для m_0..m_{n-2},
+		// решается прогонкой с поправкой Шермана-Моррисона
+		static void calculatePeriodicSlopes(const std::vector<T>& h, const std::vector<T>& delta, std::vector<T>& m) {
+			size_t count = m.size() - 1;
+			std::vector<T> lower(count);
+			std::vector<T> diagonal(count);
+			std::vector<T> upper(count);
+			std::vector<T> rhs(count);
+			
+			for (size_t i = 0; i < count; ++i) {
+				size_t prev = i == 0 ? count - 1 : i - 1;
+				
+				lower[i] = h[i];
+				diagonal[i] = 2.0 * (h[prev] + h[i]);
+				upper[i] = h[prev];
+				rhs[i] = 3.0 * (h[i] * delta[prev] + h[prev] * delta[i]);
+			}
+			
+			if (count == 2) {
+				// соседи слева и справа совпадают
+				T a01 = upper[0] + lower[0];
+				T a10 = upper[1] + lower[1];
+				T det = diagonal[0] * diagonal[1] - a01 * a10;
+				
+				m[0] = (rhs[0] * diagonal[1] - a01 * rhs[1]) / det;
+				m[1] = (diagonal[0] * rhs[1] - a10 * rhs[0]) / det;
+				m[2] = m[0];
+				return;
+			}
+			
+			T corner_first = lower[0];
+			T corner_last = upper[count - 1];
+			T gamma = -diagonal[0];
+			
+			lower[0] = T(0);
+			upper[count - 1] = T(0);
+			diagonal[0] -= gamma;
+			diagonal[count - 1] -= corner_first * corner_last / gamma;
+			
+			std::vector<T> u(count, T(0));
+			u[0] = gamma;
+			u[count - 1] = corner_last;
+			
+			std::vector<T> lower_copy = lower;
+			std::vector<T> diagonal_copy = diagonal;
+			std::vector<T> upper_copy = upper;
+			
+			solveTridiagonal(lower, diagonal, upper, rhs);
+			solveTridiagonal(lower_copy, diagonal_copy, upper_copy, u);
+			
+			T factor = (rhs[0] + corner_first / gamma * rhs[count - 1]) /
+				(T(1) + u[0] + corner_first / gamma * u[count - 1]);
+			
+			for (size_t i = 0; i < count; ++i) {
+				m[i] = rhs[i] - factor * u[i];
+			}
+			m[count] = m[0];
+		}
+		
+		// Метод прогонки; lower[0] и upper[n-1] не используются, результат в rhs
+		static void solveTridiagonal(std::vector<T>& lower, std::vector<T>& diagonal, std::vector<T>& upper, std::vector<T>& rhs) {
+			size_t n = rhs.size();
+			
+			for (size_t i = 1; i < n; ++i) {
+				T factor = lower[i] / diagonal[i - 1];
+				diagonal[i] -= factor * upper[i - 1];
+				rhs[i] -= factor * rhs[i - 1];
+			}
+			
+			rhs[n - 1] /= diagonal[n - 1];
+			for (size_t i = n - 1; i > 0; --i) {
+				rhs[i - 1] = (rhs[i - 1] - upper[i - 1] * rhs[i]) / diagonal[i - 1];
+			}
+		}
+		
+		// Кубические полиномы Эрмита по значениям и производным в узлах
+		void setHermiteSegments(const std::vector<T>& slopes) {
+			size_t n = x_values.size();
+			segments.resize(n);
+			
+			for (size_t i = 0; i < n - 1; ++i) {
+				T h = x_values[i + 1] - x_values[i];
+				T delta = (y_values[i + 1] - y_values[i]) / h;
+				
+				segments[i] = {x_values[i], y_values[i], slopes[i],
+					T((3.0 * delta - 2.0 * slopes[i] - slopes[i + 1]) / h),
+					T((slopes[i] + slopes[i + 1] - 2.0 * delta) / (h * h))};
+			}
+			segments[n - 1] = {x_values[n - 1], y_values[n - 1], T(0), T(0), T(0)};
+			
+			buildLayout();
+			buildIntervalIndex();
+			
+			coefficients_calculated = true;
+		}
+		
+		void buildLayout() {
+			if (layout != LayoutSoA) {
+				soa_a.clear();
+				soa_b.clear();
+				soa_c.clear();
+				soa_d.clear();
+				return;
+			}
+			
+			size_t count = segments.size();
+			soa_a.resize(count);
+			soa_b.resize(count);
+			soa_c.resize(count);
+			soa_d.resize(count);
+			
+			for (size_t i = 0; i < count; ++i) {
+				soa_a[i] = segments[i].a;
+				soa_b[i] = segments[i].b;
+				soa_c[i] = segments[i].c;
+				soa_d[i] = segments[i].d;
+			}
+		}
+		
+		void buildIntervalIndex() {
+			interval_index.build(segments);
+		}
+		
+		size_t findInterval(T x) const {
+			return interval_index.find(segments, x);
+		}
+		
+		size_t findInterval(T x, size_t hint) const {
+			return interval_index.find(segments, x, hint);
+		}
+		
+		T lookupTable(T x) const {
+			T position = (x - lut_origin) * lut_scale;
+			T last = T(lut_values.size() - 1);
+			
+			position = position > T(0) ? (position < last ? position : last) : T(0);
+			
+			if (!lut_linear) {
+				return lut_values[size_t(position + T(0.5))];
+			}
+			
+			size_t idx = std::min(size_t(position), lut_values.size() - 2);
+			T t = position - T(idx);
+			
+			return lut_values[idx] + t * (lut_values[idx + 1] - lut_values[idx]);
+		}
+		
+		T evaluate(size_t idx, T x) const {
+			return segments[idx].evaluate(x);
+		}
+		
+		// Сначала ищем интервалы для блока точек, затем вычисляем полиномы
+		// отдельным циклом без ветвлений, который компилятор векторизует
+		void interpolateRange(const T* xs, T* ys, size_t n) const {
+			size_t idx[batch_block];
+			size_t cursor = findInterval(xs[0]);
+			
+			for (size_t begin = 0; begin < n; begin += batch_block) {
+				size_t count = std::min(batch_block, n - begin);
+				
+				for (size_t i = 0; i < count; ++i) {
+					cursor = findInterval(xs[begin + i], cursor);
+					idx[i] = cursor;
+				}
+				
+				if (layout == LayoutSoA) {
+					for (size_t i = 0; i < count; ++i) {
+						size_t k = idx[i];
+						T dx = xs[begin + i] - x_values[k];
+						
+						ys[begin + i] = soa_a[k] + dx * (soa_b[k] + dx * (soa_c[k] + dx * soa_d[k]));
+					}
+				}
+				else {
+					for (size_t i = 0; i < count; ++i) {
+						const Segment& segment = segments[idx[i]];
+						T dx = xs[begin + i] - segment.x;
+						
+						ys[begin + i] = segment.a + dx * (segment.b + dx * (segment.c + dx * segment.d));
+					}
+				}
+			}
+		}
+	};
+	
+	// Скомпилированный сплайн: только чтение, без исключений и ленивых вычислений,
+	// один объект можно использовать из нескольких потоков одновременно.
+	// Создаётся CubicInterpolator::compile(); по умолчанию - тождественный ноль
+	template <typename T>
+	class CubicEvaluator {
+	private:
+		friend class CubicInterpolator<T>;
+		
+		typedef CubicSegment<T> Segment;
+		
+		// n - 1 интервалов и граничный узел
+		std::vector<Segment> segments;
+		CubicIntervalIndex<T> interval_index;
+		
+		T x_first;
+		T x_last;
+		
+		// Наклон продолжения за левым и правым краем (0 для ExtrapolateClamp)
+		T left_slope;
+		T right_slope;
+		
+		ExtrapolationMode extrapolation;
+		T fill;
+		
+		static constexpr size_t batch_block = 256;
+		
+		CubicEvaluator(const std::vector<Segment>& spline_segments, const CubicIntervalIndex<T>& index,
+			ExtrapolationMode mode, T fill_value) : segments(spline_segments), interval_index(index),
+			extrapolation(mode), fill(fill_value)
+		{
+			build();
+		}
+		
+	public:
+		CubicEvaluator() : extrapolation(ExtrapolateClamp), fill(T(0)) {
+			segments.resize(2);
+			segments[0] = {T(0), T(0), T(0), T(0), T(0)};
+			segments[1] = {T(1), T(0), T(0), T(0), T(0)};
+			interval_index.build(segments);
+			
+			build();
+		}
+		
+		T interpolate(T x) const noexcept {
+			T clamped = clamp(x);
+			T y = segments[interval_index.find(segments, clamped)].evaluate(clamped) + extension(x, clamped);
+			
+			y = extrapolation == ExtrapolateConstant && x != clamped ? fill : y;
+			return x != x ? x : y;
+		}
+		
+		T operator()(T x) const noexcept {
+			return interpolate(x);
+		}
+		
+		// Пакетное вычисление: интервалы блока ищутся отдельным проходом,
+		// полиномы и продолжение за край - циклом без ветвлений
+		void interpolate(const T* xs, T* ys, size_t n, unsigned int threads = 1) const {
+			threads = GetThreadsCount(n, threads, 1 << 14);
+			
+			ParallelFor(n, threads, [&](size_t begin, size_t end, unsigned int) {
+				interpolateRange(xs + begin, ys + begin, end - begin);
+			});
+		}
+		
+		void interpolate(const std::vector<T>& xs, std::vector<T>& ys, unsigned int threads = 1) const {
+			ys.resize(xs.size());
+			interpolate(xs.data(), ys.data(), xs.size(), threads);
+		}
+		
+		T getMinX() const noexcept {
+			return x_first;
+		}
+		
+		T getMaxX() const noexcept {
+			return x_last;
+		}
+		
+		ExtrapolationMode getExtrapolation() const noexcept {
+			return extrapolation;
+		}
+		
+	private:
+		void build() {
+			size_t n = segments.size();
+			
+			x_first = segments.front().x;
+			x_last = segments.back().x;
+			
+			const Segment& last = segments[n - 2];
+			T h = x_last - last.x;
+			
+			left_slope = extrapolation == ExtrapolateLinear ? segments[0].b : T(0);
+			right_slope = extrapolation == ExtrapolateLinear ? last.b + h * (T(2) * last.c + T(3) * h * last.d) : T(0);
+		}
+		
+		// NaN попадает на левый край (результат заменяется на NaN)
+		T clamp(T x) const noexcept {
+			T lower = x > x_first ? x : x_first;
+			return lower < x_last ? lower : x_last;
+		}
+		
+		// Продолжение за край; при нулевом наклоне слагаемое пропускается,
+		// иначе для x = +-inf получилось бы 0 * inf = NaN
+		T extension(T x, T clamped) const noexcept {
+			T slope = x < x_first ? left_slope : right_slope;
+			
+			return slope != T(0) ? slope * (x - clamped) : T(0);
+		}
+		
+		void interpolateRange(const T* xs, T* ys, size_t n) const noexcept {
+			size_t idx[batch_block];
+			T clamped[batch_block];
+			bool constant = extrapolation == ExtrapolateConstant;
+			
+			for (size_t begin = 0; begin < n; begin += batch_block) {
+				size_t count = std::min(batch_block, n - begin);
+				
+				for (size_t i = 0; i < count; ++i) {
+					clamped[i] = clamp(xs[begin + i]);
+					idx[i] = interval_index.find(segments, clamped[i]);
+				}
+				
+				for (size_t i = 0; i < count; ++i) {
+					T x = xs[begin + i];
+					T y = segments[idx[i]].evaluate(clamped[i]) + extension(x, clamped[i]);
+					
+					y = constant && x != clamped[i] ? fill : y;
+					ys[begin + i] = x != x ? x : y;
+				}
+			}
 		}
 	};
 
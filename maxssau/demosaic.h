@@ -0,0 +1,305 @@
+#ifndef __demosaic__
+#define __demosaic__
+
+#include <cmath>
+#include <cstddef>
+
+namespace maxssau
+{
+	enum DemosaicMode
+	{
+		FullColor=0,				// bilinear interpolation of the missing colours
+		DemosaicBilinear=0,
+		DemosaicMalvar=1,			// Malvar-He-Cutler: bilinear corrected by the gradient of the known colour
+		DemosaicEdgeDirected=2		// Hamilton-Adams: green along the smoother direction, R/B from colour differences
+	};
+
+	// Colour filter array layout, named by the 2x2 quad starting at (0,0)
+	enum BayerPattern
+	{
+		BayerRGGB=0,
+		BayerBGGR=1,
+		BayerGRBG=2,
+		BayerGBRG=3
+	};
+
+	// G1 - green pixel in the red row, G2 - green pixel in the blue row
+	enum BayerChannel
+	{
+		ChannelR=0,
+		ChannelG1=1,
+		ChannelG2=2,
+		ChannelB=3
+	};
+
+	inline unsigned int GetBayerChannel(unsigned int pattern, unsigned int x, unsigned int y)
+	{
+		static const unsigned char layout[4][4]=
+		{
+			{ChannelR, ChannelG1, ChannelG2, ChannelB},
+			{ChannelB, ChannelG2, ChannelG1, ChannelR},
+			{ChannelG1, ChannelR, ChannelB, ChannelG2},
+			{ChannelG2, ChannelB, ChannelR, ChannelG1}
+		};
+
+		return layout[pattern & 3][((y & 1) << 1) | (x & 1)];
+	}
+
+	// Reflects a coordinate into [0, size) around the border pixels, which keeps its parity
+	// and therefore its Bayer colour
+	inline long MirrorCoordinate(long coordinate, long size)
+	{
+		if(size<2)
+		{
+			return 0;
+		}
+
+		while(coordinate<0 || coordinate>=size)
+		{
+			coordinate=coordinate<0 ? -coordinate : 2*(size-1)-coordinate;
+		}
+
+		return coordinate;
+	}
+
+	// Mosaic pixels around a tile that DemosaicTile reads
+	constexpr unsigned int DemosaicBorder=3;
+
+	// Scratch floats DemosaicTile needs for a width x height tile
+	inline size_t GetDemosaicScratchSize(unsigned int width, unsigned int height)
+	{
+		return (size_t)(width+2)*(height+2);
+	}
+
+	// Every Bayer row holds one colour C (red or blue) at phase site and green at the other phase. At C sites the
+	// kernels output C, G and the other colour O; at G sites the horizontal neighbours are C and the vertical ones O.
+	// The row kernels walk pixel pairs (C at x, G at x+1) and write both pixels of a pair in one iteration, so every
+	// output plane is stored contiguously; the planes are passed as restrict pointers, otherwise gcc gives up on the
+	// run-time alias checks between three outputs and five input rows. The unpaired pixels at the row ends go through
+	// the same per-pixel code. With gcc 12 the pair loops vectorize at -O3 (SSE2 and AVX2), at -O2 they stay scalar
+	// under the very cheap cost model; per-phase stride-2 loops leave gaps in the stores and do not vectorize at all
+	template <typename SiteFunction, typename GreenFunction>
+	inline void ForEachBayerPair(long begin, long end, long site, SiteFunction site_pixel, GreenFunction green_pixel)
+	{
+		long x=begin;
+
+		if(x<end && ((x^site)&1)!=0)
+		{
+			green_pixel(x++);
+		}
+
+		for(;x+1<end;x+=2)
+		{
+			site_pixel(x);
+			green_pixel(x+1);
+		}
+
+		if(x<end)
+		{
+			site_pixel(x);
+		}
+	}
+
+	// Phase (0 or 1) of the red or blue pixels in row y
+	inline long GetColourSitePhase(unsigned int pattern, unsigned int y)
+	{
+		unsigned int channel=GetBayerChannel(pattern, 0, y);
+
+		return channel==ChannelR || channel==ChannelB ? 0 : 1;
+	}
+
+	inline void DemosaicBilinearPairs(const float* mosaic, long stride, float* __restrict same, float* __restrict green,
+		float* __restrict other, long width, long site)
+	{
+		const float* up=mosaic-stride;
+		const float* down=mosaic+stride;
+
+		// same colour, cross (green) and diagonal (the other colour) neighbours
+		auto site_pixel=[=](long x)
+		{
+			same[x]=mosaic[x];
+			green[x]=(mosaic[x-1]+mosaic[x+1]+up[x]+down[x])*0.25f;
+			other[x]=(up[x-1]+up[x+1]+down[x-1]+down[x+1])*0.25f;
+		};
+
+		auto green_pixel=[=](long x)
+		{
+			same[x]=(mosaic[x-1]+mosaic[x+1])*0.5f;
+			green[x]=mosaic[x];
+			other[x]=(up[x]+down[x])*0.5f;
+		};
+
+		ForEachBayerPair(0, width, site, site_pixel, green_pixel);
+	}
+
+	// Bilinear demosaic of one row into red, green and blue planes.
+	// mosaic points to pixel 0 of row y in a float mosaic with at least one pixel of border on every side,
+	// pattern is the Bayer pattern of the mosaic origin
+	inline void DemosaicBilinearRow(const float* mosaic, long stride, float* red, float* green, float* blue,
+		unsigned int width, unsigned int pattern, unsigned int y)
+	{
+		long site=GetColourSitePhase(pattern, y);
+		bool red_row=GetBayerChannel(pattern, (unsigned int)site, y)==ChannelR;
+
+		DemosaicBilinearPairs(mosaic, stride, red_row ? red : blue, green, red_row ? blue : red, width, site);
+	}
+
+	inline void DemosaicMalvarPairs(const float* mosaic, long stride, float* __restrict same, float* __restrict green,
+		float* __restrict other, long width, long site)
+	{
+		const float* up2=mosaic-2*stride;
+		const float* up=mosaic-stride;
+		const float* down=mosaic+stride;
+		const float* down2=mosaic+2*stride;
+
+		auto site_pixel=[=](long x)
+		{
+			float center=mosaic[x];
+			float cross=mosaic[x-1]+mosaic[x+1]+up[x]+down[x];
+			float diagonal=up[x-1]+up[x+1]+down[x-1]+down[x+1];
+			float distant=mosaic[x-2]+mosaic[x+2]+up2[x]+down2[x];
+
+			same[x]=center;
+			green[x]=(4.0f*center+2.0f*cross-distant)*0.125f;
+			other[x]=(6.0f*center+2.0f*diagonal-1.5f*distant)*0.125f;
+		};
+
+		auto green_pixel=[=](long x)
+		{
+			float center=mosaic[x];
+			float diagonal=up[x-1]+up[x+1]+down[x-1]+down[x+1];
+			float far_horizontal=mosaic[x-2]+mosaic[x+2];
+			float far_vertical=up2[x]+down2[x];
+
+			same[x]=(5.0f*center+4.0f*(mosaic[x-1]+mosaic[x+1])-far_horizontal-diagonal+0.5f*far_vertical)*0.125f;
+			green[x]=center;
+			other[x]=(5.0f*center+4.0f*(up[x]+down[x])-far_vertical-diagonal+0.5f*far_horizontal)*0.125f;
+		};
+
+		ForEachBayerPair(0, width, site, site_pixel, green_pixel);
+	}
+
+	// Malvar-He-Cutler 5x5 filters for one row, needs two pixels of border
+	inline void DemosaicMalvarRow(const float* mosaic, long stride, float* red, float* green, float* blue,
+		unsigned int width, unsigned int pattern, unsigned int y)
+	{
+		long site=GetColourSitePhase(pattern, y);
+		bool red_row=GetBayerChannel(pattern, (unsigned int)site, y)==ChannelR;
+
+		DemosaicMalvarPairs(mosaic, stride, red_row ? red : blue, green, red_row ? blue : red, width, site);
+	}
+
+	// Hamilton-Adams green at R/B sites of one row: interpolation along the direction
+	// with the smaller gradient, corrected by the Laplacian of the site colour.
+	// Row and columns may start at -1 (green is needed around the tile for the second pass)
+	inline void InterpolateGreenRow(const float* mosaic, long stride, float* __restrict green, long x_begin, long x_end,
+		unsigned int pattern, long y)
+	{
+		const float* up2=mosaic-2*stride;
+		const float* up=mosaic-stride;
+		const float* down=mosaic+stride;
+		const float* down2=mosaic+2*stride;
+
+		auto site_pixel=[=](long x)
+		{
+			float center2=2.0f*mosaic[x];
+			float laplacian_h=center2-mosaic[x-2]-mosaic[x+2];
+			float laplacian_v=center2-up2[x]-down2[x];
+			float gradient_h=std::fabs(mosaic[x-1]-mosaic[x+1])+std::fabs(laplacian_h);
+			float gradient_v=std::fabs(up[x]-down[x])+std::fabs(laplacian_v);
+			float estimate_h=(mosaic[x-1]+mosaic[x+1])*0.5f+laplacian_h*0.25f;
+			float estimate_v=(up[x]+down[x])*0.5f+laplacian_v*0.25f;
+			// the estimate along the smaller gradient, the mean of both on a tie: each select picks estimate_h or estimate_v,
+			// so the sum is twice the chosen one or the sum of both. Written as gradient_h<gradient_v ? estimate_h : ... the
+			// estimates are sunk into branches that gcc does not if-convert back under the default -ftrapping-math
+			float first=gradient_h<gradient_v ? estimate_h : estimate_v;
+			float second=gradient_v<gradient_h ? estimate_v : estimate_h;
+
+			green[x]=(first+second)*0.5f;
+		};
+
+		auto green_pixel=[=](long x)
+		{
+			green[x]=mosaic[x];
+		};
+
+		ForEachBayerPair(x_begin, x_end, GetColourSitePhase(pattern, (unsigned int)y), site_pixel, green_pixel);
+	}
+
+	// R and B of one row of the edge directed demosaic: bilinear interpolation of the colour differences
+	// with the full green plane g (one pixel of border)
+	inline void InterpolateColourDifferencePairs(const float* mosaic, long stride, const float* g, long green_stride,
+		float* __restrict same, float* __restrict green, float* __restrict other, long width, long site)
+	{
+		const float* up=mosaic-stride;
+		const float* down=mosaic+stride;
+		const float* g_up=g-green_stride;
+		const float* g_down=g+green_stride;
+
+		auto site_pixel=[=](long x)
+		{
+			same[x]=mosaic[x];
+			green[x]=g[x];
+			other[x]=g[x]+((up[x-1]-g_up[x-1])+(up[x+1]-g_up[x+1])+
+				(down[x-1]-g_down[x-1])+(down[x+1]-g_down[x+1]))*0.25f;
+		};
+
+		auto green_pixel=[=](long x)
+		{
+			same[x]=g[x]+((mosaic[x-1]-g[x-1])+(mosaic[x+1]-g[x+1]))*0.5f;
+			green[x]=g[x];
+			other[x]=g[x]+((up[x]-g_up[x])+(down[x]-g_down[x]))*0.5f;
+		};
+
+		ForEachBayerPair(0, width, site, site_pixel, green_pixel);
+	}
+
+	// Demosaic of a width x height tile into red, green and blue planes (plane_stride floats per row).
+	// mosaic points to pixel (0,0) of the tile with DemosaicBorder pixels of border on every side,
+	// pattern is the Bayer pattern of that pixel, scratch holds GetDemosaicScratchSize floats.
+	// Unknown modes fall back to bilinear
+	inline void DemosaicTile(unsigned int mode, const float* mosaic, long stride, unsigned int width, unsigned int height,
+		unsigned int pattern, float* red, float* green, float* blue, long plane_stride, float* scratch)
+	{
+		if(mode!=DemosaicEdgeDirected)
+		{
+			for(unsigned int y=0;y<height;y++)
+			{
+				const float* row=mosaic+(long)y*stride;
+				long offset=(long)y*plane_stride;
+
+				if(mode==DemosaicMalvar)
+				{
+					DemosaicMalvarRow(row, stride, red+offset, green+offset, blue+offset, width, pattern, y);
+				}
+				else
+				{
+					DemosaicBilinearRow(row, stride, red+offset, green+offset, blue+offset, width, pattern, y);
+				}
+			}
+			return;
+		}
+
+		// Edge directed: full green plane with one pixel around the tile, then R and B
+		// from the bilinear interpolation of the colour differences R-G and B-G
+		long green_stride=(long)width+2;
+		float* full_green=scratch+green_stride+1;
+
+		for(long y=-1;y<=(long)height;y++)
+		{
+			InterpolateGreenRow(mosaic+y*stride, stride, full_green+y*green_stride, -1, (long)width+1, pattern, y);
+		}
+
+		for(unsigned int y=0;y<height;y++)
+		{
+			long offset=(long)y*plane_stride;
+			long site=GetColourSitePhase(pattern, y);
+			bool red_row=GetBayerChannel(pattern, (unsigned int)site, y)==ChannelR;
+
+			InterpolateColourDifferencePairs(mosaic+(long)y*stride, stride, full_green+(long)y*green_stride, green_stride,
+				(red_row ? red : blue)+offset, green+offset, (red_row ? blue : red)+offset, width, site);
+		}
+	}
+}
+
+#endif
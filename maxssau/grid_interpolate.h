@@ -0,0 +1,546 @@
+#ifndef __grid__interpolation__
+#define __grid__interpolation__
+
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+
+#include "cubic_interpolate.h"
+#include "parallel.h"
+
+namespace maxssau
+{
+
+	// Базис Эрмита на интервале длины h, t = (x - x_i) / h:
+	// basis[0], basis[1] - веса значений в левом и правом узле,
+	// basis[2], basis[3] - веса производных в левом и правом узле
+	template <typename T>
+	inline void hermiteBasis(T t, T h, T* basis) {
+		T t2 = t * t;
+		T t3 = t2 * t;
+
+		basis[0] = 2.0 * t3 - 3.0 * t2 + 1.0;
+		basis[1] = -2.0 * t3 + 3.0 * t2;
+		basis[2] = (t3 - 2.0 * t2 + t) * h;
+		basis[3] = (t3 - t2) * h;
+	}
+
+	// Интервал сетки knots, содержащий x, и базис Эрмита для него
+	template <typename T>
+	inline size_t locateGridInterval(const std::vector<T>& knots, T x, T* basis) {
+		auto it = std::upper_bound(knots.begin(), knots.end(), x);
+		size_t idx = std::distance(knots.begin(), it);
+
+		idx = idx == 0 ? 0 : std::min(idx - 1, knots.size() - 2);
+
+		T h = knots[idx + 1] - knots[idx];
+		hermiteBasis((x - knots[idx]) / h, h, basis);
+
+		return idx;
+	}
+
+	// Производные по одной оси во всех узлах сетки: вдоль оси knots.size() значений
+	// с шагом stride, каждая линия интерполируется одномерным сплайном вида type
+	template <typename T>
+	void calculateAxisDerivatives(const std::vector<T>& source, std::vector<T>& result,
+		const std::vector<T>& knots, size_t stride, SplineType type) {
+		size_t n = knots.size();
+		size_t slab = stride * n;
+		std::vector<T> line(n);
+
+		result.resize(source.size());
+
+		for (size_t outer = 0; outer < source.size(); outer += slab) {
+			for (size_t inner = 0; inner < stride; ++inner) {
+				const T* values = source.data() + outer + inner;
+
+				for (size_t k = 0; k < n; ++k) {
+					line[k] = values[k * stride];
+				}
+
+				CubicInterpolator<T> spline(knots, line);
+				spline.setSplineType(type);
+				std::vector<T> derivatives = spline.getKnotDerivatives();
+
+				for (size_t k = 0; k < n; ++k) {
+					result[outer + inner + k * stride] = derivatives[k];
+				}
+			}
+		}
+	}
+
+	// Двумерный (бикубический) сплайн на прямоугольной сетке - тензорное произведение
+	// одномерных сплайнов. Производные fx, fy, fxy в узлах берутся из одномерных
+	// сплайнов вдоль строк и столбцов, в ячейке вычисляется бикубический полином Эрмита
+	template <typename T>
+	class BicubicInterpolator {
+	private:
+		std::vector<T> x_values;  // Узлы по x (nx)
+		std::vector<T> y_values;  // Узлы по y (ny)
+
+		// Значения и производные в узлах, индекс j * nx + i
+		std::vector<T> f;
+		std::vector<T> fx;
+		std::vector<T> fy;
+		std::vector<T> fxy;
+
+		SplineType spline_type;
+		bool derivatives_calculated;
+
+	public:
+		BicubicInterpolator() : spline_type(SplineNatural), derivatives_calculated(false) {}
+
+		// values - значения в узлах по строкам: values[j * x.size() + i] = f(x_i, y_j)
+		BicubicInterpolator(const std::vector<T>& x, const std::vector<T>& y, const std::vector<T>& values)
+			: spline_type(SplineNatural), derivatives_calculated(false)
+		{
+			setPoints(x, y, values);
+		}
+
+		void setPoints(const std::vector<T>& x, const std::vector<T>& y, const std::vector<T>& values) {
+			if (x.size() < 2 || y.size() < 2) {
+				throw std::invalid_argument("At least 2 points are required for interpolation on each axis");
+			}
+			if (values.size() != x.size() * y.size()) {
+				throw std::invalid_argument("Values count must be equal to x.size() * y.size()");
+			}
+
+			x_values = x;
+			y_values = y;
+			f = values;
+			derivatives_calculated = false;
+		}
+
+		// Вид одномерных сплайнов, по которым оцениваются производные
+		void setSplineType(SplineType type) {
+			spline_type = type;
+			derivatives_calculated = false;
+		}
+
+		void calculateDerivatives() {
+			size_t nx = x_values.size();
+
+			calculateAxisDerivatives(f, fx, x_values, 1, spline_type);
+			calculateAxisDerivatives(f, fy, y_values, nx, spline_type);
+			calculateAxisDerivatives(fx, fxy, y_values, nx, spline_type);
+
+			derivatives_calculated = true;
+		}
+
+		T interpolate(T x, T y) {
+			if (!derivatives_calculated) {
+				calculateDerivatives();
+			}
+
+			if (x < x_values.front() || x > x_values.back() || y < y_values.front() || y > y_values.back()) {
+				throw std::out_of_range("Point is out of interpolation range");
+			}
+
+			T bx[4];
+			T by[4];
+			size_t i = locateGridInterval(x_values, x, bx);
+			size_t j = locateGridInterval(y_values, y, by);
+
+			return evaluate(i, j, bx, by);
+		}
+
+		// Пакетная интерполяция в точках (xs[k], ys[k])
+		void interpolate(const T* xs, const T* ys, T* result, size_t n, unsigned int threads = 1) {
+			if (!derivatives_calculated) {
+				calculateDerivatives();
+			}
+
+			for (size_t k = 0; k < n; ++k) {
+				if (xs[k] < x_values.front() || xs[k] > x_values.back() || ys[k] < y_values.front() || ys[k] > y_values.back()) {
+					throw std::out_of_range("Point is out of interpolation range");
+				}
+			}
+
+			threads = GetThreadsCount(n, threads, 1 << 12);
+
+			ParallelFor(n, threads, [&](size_t begin, size_t end, unsigned int) {
+				T bx[4];
+				T by[4];
+
+				for (size_t k = begin; k < end; ++k) {
+					size_t i = locateGridInterval(x_values, xs[k], bx);
+					size_t j = locateGridInterval(y_values, ys[k], by);
+
+					result[k] = evaluate(i, j, bx, by);
+				}
+			});
+		}
+
+		// Передискретизация на равномерную сетку width x height, покрывающую весь диапазон узлов
+		// (углы совпадают): output[row * width + col]. Базисы столбцов считаются один раз,
+		// для каждой строки узлы сначала сворачиваются по y, затем каждый пиксель - 4 умножения
+		void resample(T* output, size_t width, size_t height, unsigned int threads = 1) {
+			if (width < 2 || height < 2) {
+				throw std::invalid_argument("Output grid must be at least 2 x 2");
+			}
+
+			if (!derivatives_calculated) {
+				calculateDerivatives();
+			}
+
+			size_t nx = x_values.size();
+			std::vector<size_t> column_index(width);
+			std::vector<T> column_basis(width * 4);
+
+			for (size_t col = 0; col < width; ++col) {
+				T x = x_values.front() + (x_values.back() - x_values.front()) * col / (width - 1);
+				column_index[col] = locateGridInterval(x_values, x, &column_basis[col * 4]);
+			}
+
+			threads = GetThreadsCount(height, threads, 16);
+
+			ParallelFor(height, threads, [&](size_t begin, size_t end, unsigned int) {
+				std::vector<T> g(nx);
+				std::vector<T> gx(nx);
+				T by[4];
+
+				for (size_t row = begin; row < end; ++row) {
+					T y = y_values.front() + (y_values.back() - y_values.front()) * row / (height - 1);
+					size_t j = locateGridInterval(y_values, y, by);
+					size_t n0 = j * nx;
+					size_t n1 = n0 + nx;
+
+					for (size_t i = 0; i < nx; ++i) {
+						g[i] = by[0] * f[n0 + i] + by[1] * f[n1 + i] + by[2] * fy[n0 + i] + by[3] * fy[n1 + i];
+						gx[i] = by[0] * fx[n0 + i] + by[1] * fx[n1 + i] + by[2] * fxy[n0 + i] + by[3] * fxy[n1 + i];
+					}
+
+					T* out = output + row * width;
+
+					for (size_t col = 0; col < width; ++col) {
+						size_t i = column_index[col];
+						const T* bx = &column_basis[col * 4];
+
+						out[col] = bx[0] * g[i] + bx[1] * g[i + 1] + bx[2] * gx[i] + bx[3] * gx[i + 1];
+					}
+				}
+			});
+		}
+
+		void resample(std::vector<T>& output, size_t width, size_t height, unsigned int threads = 1) {
+			output.resize(width * height);
+			resample(output.data(), width, height, threads);
+		}
+
+	private:
+		T evaluate(size_t i, size_t j, const T* bx, const T* by) const {
+			size_t n00 = j * x_values.size() + i;
+			size_t n10 = n00 + 1;
+			size_t n01 = n00 + x_values.size();
+			size_t n11 = n01 + 1;
+
+			return by[0] * (bx[0] * f[n00] + bx[1] * f[n10] + bx[2] * fx[n00] + bx[3] * fx[n10])
+				+ by[1] * (bx[0] * f[n01] + bx[1] * f[n11] + bx[2] * fx[n01] + bx[3] * fx[n11])
+				+ by[2] * (bx[0] * fy[n00] + bx[1] * fy[n10] + bx[2] * fxy[n00] + bx[3] * fxy[n10])
+				+ by[3] * (bx[0] * fy[n01] + bx[1] * fy[n11] + bx[2] * fxy[n01] + bx[3] * fxy[n11]);
+		}
+	};
+
+	// Трёхмерный (трикубический) сплайн на прямоугольной сетке, построенный так же,
+	// как двумерный: восемь массивов производных в узлах и трикубический полином Эрмита
+	template <typename T>
+	class TricubicInterpolator {
+	private:
+		std::vector<T> x_values;
+		std::vector<T> y_values;
+		std::vector<T> z_values;
+
+		// derivatives[m]: бит 0 - производная по x, бит 1 - по y, бит 2 - по z;
+		// индекс узла (k * ny + j) * nx + i
+		std::vector<T> derivatives[8];
+
+		SplineType spline_type;
+		bool derivatives_calculated;
+
+	public:
+		TricubicInterpolator() : spline_type(SplineNatural), derivatives_calculated(false) {}
+
+		// values[(k * y.size() + j) * x.size() + i] = f(x_i, y_j, z_k)
+		TricubicInterpolator(const std::vector<T>& x, const std::vector<T>& y, const std::vector<T>& z, const std::vector<T>& values)
+			: spline_type(SplineNatural), derivatives_calculated(false)
+		{
+			setPoints(x, y, z, values);
+		}
+
+		void setPoints(const std::vector<T>& x, const std::vector<T>& y, const std::vector<T>& z, const std::vector<T>& values) {
+			if (x.size() < 2 || y.size() < 2 || z.size() < 2) {
+				throw std::invalid_argument("At least 2 points are required for interpolation on each axis");
+			}
+			if (values.size() != x.size() * y.size() * z.size()) {
+				throw std::invalid_argument("Values count must be equal to x.size() * y.size() * z.size()");
+			}
+
+			x_values = x;
+			y_values = y;
+			z_values = z;
+			derivatives[0] = values;
+			derivatives_calculated = false;
+		}
+
+		void setSplineType(SplineType type) {
+			spline_type = type;
+			derivatives_calculated = false;
+		}
+
+		void calculateDerivatives() {
+			size_t nx = x_values.size();
+			size_t nxy = nx * y_values.size();
+
+			calculateAxisDerivatives(derivatives[0], derivatives[1], x_values, 1, spline_type);
+			calculateAxisDerivatives(derivatives[0], derivatives[2], y_values, nx, spline_type);
+			calculateAxisDerivatives(derivatives[1], derivatives[3], y_values, nx, spline_type);
+
+			for (size_t m = 0; m < 4; ++m) {
+				calculateAxisDerivatives(derivatives[m], derivatives[m + 4], z_values, nxy, spline_type);
+			}
+
+			derivatives_calculated = true;
+		}
+
+		T interpolate(T x, T y, T z) {
+			if (!derivatives_calculated) {
+				calculateDerivatives();
+			}
+
+			if (x < x_values.front() || x > x_values.back() || y < y_values.front() || y > y_values.back() ||
+				z < z_values.front() || z > z_values.back()) {
+				throw std::out_of_range("Point is out of interpolation range");
+			}
+
+			T bx[4];
+			T by[4];
+			T bz[4];
+			size_t i = locateGridInterval(x_values, x, bx);
+			size_t j = locateGridInterval(y_values, y, by);
+			size_t k = locateGridInterval(z_values, z, bz);
+
+			T g[2];
+			T gx[2];
+			reduceYZ(i, j, k, by, bz, 2, g, gx);
+
+			return bx[0] * g[0] + bx[1] * g[1] + bx[2] * gx[0] + bx[3] * gx[1];
+		}
+
+		// Передискретизация на равномерную сетку width x height x depth по всему диапазону узлов:
+		// output[(layer * height + row) * width + col]; строки распределяются между потоками
+		void resample(T* output, size_t width, size_t height, size_t depth, unsigned int threads = 1) {
+			if (width < 2 || height < 2 || depth < 2) {
+				throw std::invalid_argument("Output grid must be at least 2 x 2 x 2");
+			}
+
+			if (!derivatives_calculated) {
+				calculateDerivatives();
+			}
+
+			size_t nx = x_values.size();
+			std::vector<size_t> column_index(width);
+			std::vector<T> column_basis(width * 4);
+
+			for (size_t col = 0; col < width; ++col) {
+				T x = x_values.front() + (x_values.back() - x_values.front()) * col / (width - 1);
+				column_index[col] = locateGridInterval(x_values, x, &column_basis[col * 4]);
+			}
+
+			size_t rows = height * depth;
+			threads = GetThreadsCount(rows, threads, 16);
+
+			ParallelFor(rows, threads, [&](size_t begin, size_t end, unsigned int) {
+				std::vector<T> g(nx);
+				std::vector<T> gx(nx);
+				T by[4];
+				T bz[4];
+
+				for (size_t line = begin; line < end; ++line) {
+					size_t row = line % height;
+					size_t layer = line / height;
+
+					T y = y_values.front() + (y_values.back() - y_values.front()) * row / (height - 1);
+					T z = z_values.front() + (z_values.back() - z_values.front()) * layer / (depth - 1);
+					size_t j = locateGridInterval(y_values, y, by);
+					size_t k = locateGridInterval(z_values, z, bz);
+
+					reduceYZ(0, j, k, by, bz, nx, g.data(), gx.data());
+
+					T* out = output + line * width;
+
+					for (size_t col = 0; col < width; ++col) {
+						size_t i = column_index[col];
+						const T* bx = &column_basis[col * 4];
+
+						out[col] = bx[0] * g[i] + bx[1] * g[i + 1] + bx[2] * gx[i] + bx[3] * gx[i + 1];
+					}
+				}
+			});
+		}
+
+	private:
+		// Свёртка по y и z для count узлов строки начиная с first: g - значения, gx - производные по x
+		void reduceYZ(size_t first, size_t j, size_t k, const T* by, const T* bz, size_t count, T* g, T* gx) const {
+			size_t nx = x_values.size();
+			size_t nxy = nx * y_values.size();
+
+			for (size_t c = 0; c < count; ++c) {
+				T value = 0;
+				T value_x = 0;
+
+				for (size_t corner = 0; corner < 4; ++corner) {
+					size_t cy = corner & 1;
+					size_t cz = corner >> 1;
+					size_t node = (k + cz) * nxy + (j + cy) * nx + first + c;
+
+					for (size_t m = 0; m < 4; ++m) {
+						size_t my = m & 1;
+						size_t mz = m >> 1;
+						T weight = by[cy + 2 * my] * bz[cz + 2 * mz];
+						size_t index = (my << 1) | (mz << 2);
+
+						value += weight * derivatives[index][node];
+						value_x += weight * derivatives[index | 1][node];
+					}
+				}
+
+				g[c] = value;
+				gx[c] = value_x;
+			}
+		}
+	};
+
+	// Трёхмерная цветовая таблица (3D LUT) size x size x size узлов с RGB в каждом узле:
+	// table[((b * size + g) * size + r) * 3 + channel] (красный меняется быстрее всех, как в .cube).
+	// Вход - RGB в диапазоне [0, input_max], значения за пределами ограничиваются
+	template <typename T>
+	class ColorLUT3D {
+	private:
+		size_t lut_size;
+		std::vector<T> table;
+		T scale;
+
+	public:
+		ColorLUT3D(size_t size, const std::vector<T>& rgb_table, T input_max = T(1)) {
+			if (size < 2) {
+				throw std::invalid_argument("3D LUT must have at least 2 nodes per axis");
+			}
+			if (rgb_table.size() != size * size * size * 3) {
+				throw std::invalid_argument("3D LUT table must contain size^3 RGB triples");
+			}
+
+			lut_size = size;
+			table = rgb_table;
+			scale = T(size - 1) / input_max;
+		}
+
+		size_t getSize() const {
+			return lut_size;
+		}
+
+		// Трилинейная интерполяция по 8 узлам
+		void lookupTrilinear(const T* rgb, T* result) const {
+			size_t index[3];
+			T fraction[3];
+			locate(rgb, index, fraction);
+
+			size_t stride_g = lut_size * 3;
+			size_t stride_b = lut_size * lut_size * 3;
+			const T* c000 = &table[index[2] * stride_b + index[1] * stride_g + index[0] * 3];
+
+			for (size_t ch = 0; ch < 3; ++ch) {
+				T c00 = c000[ch] + fraction[0] * (c000[3 + ch] - c000[ch]);
+				T c10 = c000[stride_g + ch] + fraction[0] * (c000[stride_g + 3 + ch] - c000[stride_g + ch]);
+				T c01 = c000[stride_b + ch] + fraction[0] * (c000[stride_b + 3 + ch] - c000[stride_b + ch]);
+				T c11 = c000[stride_b + stride_g + ch] + fraction[0] * (c000[stride_b + stride_g + 3 + ch] - c000[stride_b + stride_g + ch]);
+				T c0 = c00 + fraction[1] * (c10 - c00);
+				T c1 = c01 + fraction[1] * (c11 - c01);
+
+				result[ch] = c0 + fraction[2] * (c1 - c0);
+			}
+		}
+
+		// Тетраэдрическая интерполяция: куб делится на 6 тетраэдров по порядку дробных
+		// частей, используется 4 узла вместо 8 и сохраняется нейтральная ось
+		void lookupTetrahedral(const T* rgb, T* result) const {
+			size_t index[3];
+			T fr[3];
+			locate(rgb, index, fr);
+
+			size_t sr = 3;
+			size_t sg = lut_size * 3;
+			size_t sb = lut_size * lut_size * 3;
+			const T* c000 = &table[index[2] * sb + index[1] * sg + index[0] * 3];
+
+			// Вершины пути от c000 к c111 и веса рёбер
+			size_t first;
+			size_t second;
+			T w1;
+			T w2;
+			T w3;
+
+			if (fr[0] > fr[1]) {
+				if (fr[1] > fr[2]) {
+					first = sr; second = sr + sg; w1 = fr[0]; w2 = fr[1]; w3 = fr[2];
+				}
+				else if (fr[0] > fr[2]) {
+					first = sr; second = sr + sb; w1 = fr[0]; w2 = fr[2]; w3 = fr[1];
+				}
+				else {
+					first = sb; second = sr + sb; w1 = fr[2]; w2 = fr[0]; w3 = fr[1];
+				}
+			}
+			else {
+				if (fr[2] > fr[1]) {
+					first = sb; second = sg + sb; w1 = fr[2]; w2 = fr[1]; w3 = fr[0];
+				}
+				else if (fr[2] > fr[0]) {
+					first = sg; second = sg + sb; w1 = fr[1]; w2 = fr[2]; w3 = fr[0];
+				}
+				else {
+					first = sg; second = sr + sg; w1 = fr[1]; w2 = fr[0]; w3 = fr[2];
+				}
+			}
+
+			size_t last = sr + sg + sb;
+
+			for (size_t ch = 0; ch < 3; ++ch) {
+				result[ch] = c000[ch] + w1 * (c000[first + ch] - c000[ch])
+					+ w2 * (c000[second + ch] - c000[first + ch])
+					+ w3 * (c000[last + ch] - c000[second + ch]);
+			}
+		}
+
+		// Преобразование изображения из pixels RGB-троек, пиксели делятся между потоками
+		void apply(const T* input, T* output, size_t pixels, bool tetrahedral = true, unsigned int threads = 1) const {
+			threads = GetThreadsCount(pixels, threads, 1 << 14);
+
+			ParallelFor(pixels, threads, [&](size_t begin, size_t end, unsigned int) {
+				for (size_t p = begin; p < end; ++p) {
+					if (tetrahedral) {
+						lookupTetrahedral(input + p * 3, output + p * 3);
+					}
+					else {
+						lookupTrilinear(input + p * 3, output + p * 3);
+					}
+				}
+			});
+		}
+
+	private:
+		void locate(const T* rgb, size_t* index, T* fraction) const {
+			T last = T(lut_size - 1);
+
+			for (size_t ch = 0; ch < 3; ++ch) {
+				T position = rgb[ch] * scale;
+				position = position > T(0) ? (position < last ? position : last) : T(0);
+
+				index[ch] = std::min(size_t(position), lut_size - 2);
+				fraction[ch] = position - T(index[ch]);
+			}
+		}
+	};
+
+}
+
+#endif
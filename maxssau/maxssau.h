@@ -33,14 +33,42 @@
     #include "minmax.h"
 #endif
 
+#ifdef __use__statistics__
+    #include "statistics.h"
+#endif
+
+#ifdef __use__demosaic__
+    #include "demosaic.h"
+#endif
+
+#ifdef __use__raw__file__
+    #include "raw_file.h"
+#endif
+
 #ifdef __use__raw__
     #include "raw.h"
 #endif
 
+#ifdef __use__raw__batch__
+    #include "raw_batch.h"
+#endif
+
 #ifdef __use__cubic__interpolation__
 	#include "cubic_interpolate.h"
 #endif
 
+#ifdef __use__spline__fit__
+	#include "spline_fit.h"
+#endif
+
+#ifdef __use__grid__interpolation__
+	#include "grid_interpolate.h"
+#endif
+
+#ifdef __use__resize__
+	#include "resize.h"
+#endif
+
 #ifdef __use__matrix__
 	#include "matrix.h"
 #endif
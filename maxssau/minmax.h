@@ -1,13 +1,160 @@
 #ifndef __minmax__
 #define __minmax__
 
+#include <algorithm>
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <iomanip>
 #include <iostream>
 #include <limits>
+#include <type_traits>
+#include <vector>
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+#endif
+
+#include "parallel.h"
 
 namespace maxssau
 {
+#if defined(__AVX2__)
+    // Vector operations of MinMaxRangeAVX2 per element type; Supported is false for types without
+    // AVX2 min/max instructions (64-bit integers), which stay on the scalar loops
+    template <typename Type> struct MinMaxAVX2
+    {
+        static constexpr bool Supported = false;
+    };
+
+    template <typename Type> struct MinMaxAVX2Integer
+    {
+        static constexpr bool Supported = true;
+
+        static __m256i Load(const Type* data)
+        {
+            return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+        }
+
+        static void Store(Type* data, __m256i value)
+        {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(data), value);
+        }
+    };
+
+    template <> struct MinMaxAVX2<uint8_t> : MinMaxAVX2Integer<uint8_t>
+    {
+        static __m256i Set(uint8_t value) { return _mm256_set1_epi8((char)value); }
+        static __m256i Min(__m256i a, __m256i b) { return _mm256_min_epu8(a, b); }
+        static __m256i Max(__m256i a, __m256i b) { return _mm256_max_epu8(a, b); }
+    };
+
+    template <> struct MinMaxAVX2<int8_t> : MinMaxAVX2Integer<int8_t>
+    {
+        static __m256i Set(int8_t value) { return _mm256_set1_epi8(value); }
+        static __m256i Min(__m256i a, __m256i b) { return _mm256_min_epi8(a, b); }
+        static __m256i Max(__m256i a, __m256i b) { return _mm256_max_epi8(a, b); }
+    };
+
+    template <> struct MinMaxAVX2<uint16_t> : MinMaxAVX2Integer<uint16_t>
+    {
+        static __m256i Set(uint16_t value) { return _mm256_set1_epi16((short)value); }
+        static __m256i Min(__m256i a, __m256i b) { return _mm256_min_epu16(a, b); }
+        static __m256i Max(__m256i a, __m256i b) { return _mm256_max_epu16(a, b); }
+    };
+
+    template <> struct MinMaxAVX2<int16_t> : MinMaxAVX2Integer<int16_t>
+    {
+        static __m256i Set(int16_t value) { return _mm256_set1_epi16(value); }
+        static __m256i Min(__m256i a, __m256i b) { return _mm256_min_epi16(a, b); }
+        static __m256i Max(__m256i a, __m256i b) { return _mm256_max_epi16(a, b); }
+    };
+
+    template <> struct MinMaxAVX2<uint32_t> : MinMaxAVX2Integer<uint32_t>
+    {
+        static __m256i Set(uint32_t value) { return _mm256_set1_epi32((int)value); }
+        static __m256i Min(__m256i a, __m256i b) { return _mm256_min_epu32(a, b); }
+        static __m256i Max(__m256i a, __m256i b) { return _mm256_max_epu32(a, b); }
+    };
+
+    template <> struct MinMaxAVX2<int32_t> : MinMaxAVX2Integer<int32_t>
+    {
+        static __m256i Set(int32_t value) { return _mm256_set1_epi32(value); }
+        static __m256i Min(__m256i a, __m256i b) { return _mm256_min_epi32(a, b); }
+        static __m256i Max(__m256i a, __m256i b) { return _mm256_max_epi32(a, b); }
+    };
+
+    // min_ps/max_ps return the second operand when either one is NaN: with the element first a NaN element
+    // keeps the accumulator, as the scalar comparisons do
+    template <> struct MinMaxAVX2<float>
+    {
+        static constexpr bool Supported = true;
+
+        static __m256 Load(const float* data) { return _mm256_loadu_ps(data); }
+        static void Store(float* data, __m256 value) { _mm256_storeu_ps(data, value); }
+        static __m256 Set(float value) { return _mm256_set1_ps(value); }
+        static __m256 Min(__m256 a, __m256 b) { return _mm256_min_ps(a, b); }
+        static __m256 Max(__m256 a, __m256 b) { return _mm256_max_ps(a, b); }
+    };
+
+    template <> struct MinMaxAVX2<double>
+    {
+        static constexpr bool Supported = true;
+
+        static __m256d Load(const double* data) { return _mm256_loadu_pd(data); }
+        static void Store(double* data, __m256d value) { _mm256_storeu_pd(data, value); }
+        static __m256d Set(double value) { return _mm256_set1_pd(value); }
+        static __m256d Min(__m256d a, __m256d b) { return _mm256_min_pd(a, b); }
+        static __m256d Max(__m256d a, __m256d b) { return _mm256_max_pd(a, b); }
+    };
+
+    // AVX2 kernel of MinMax::Calculate: two vectors (64 bytes) per step into two pairs of accumulators,
+    // reduced at the end. Returns the number of elements done, the scalar loops take the rest
+    template <typename Type>
+    inline size_t MinMaxRangeAVX2(const Type* data, size_t count, Type& min_value, Type& max_value)
+    {
+        typedef MinMaxAVX2<Type> Ops;
+        const size_t Width = 32 / sizeof(Type);
+
+        if (count < 2 * Width)
+        {
+            return 0;
+        }
+
+        auto min0 = Ops::Set(min_value);
+        auto max0 = Ops::Set(max_value);
+        auto min1 = min0;
+        auto max1 = max0;
+        size_t i = 0;
+
+        for (; i + 2 * Width <= count; i += 2 * Width)
+        {
+            auto value0 = Ops::Load(data + i);
+            auto value1 = Ops::Load(data + i + Width);
+
+            min0 = Ops::Min(value0, min0);
+            max0 = Ops::Max(value0, max0);
+            min1 = Ops::Min(value1, min1);
+            max1 = Ops::Max(value1, max1);
+        }
+
+        Type lane_min[32 / sizeof(Type)];
+        Type lane_max[32 / sizeof(Type)];
+
+        Ops::Store(lane_min, Ops::Min(min1, min0));
+        Ops::Store(lane_max, Ops::Max(max1, max0));
+
+        for (size_t l = 0; l < Width; l++)
+        {
+            min_value = lane_min[l] < min_value ? lane_min[l] : min_value;
+            max_value = max_value < lane_max[l] ? lane_max[l] : max_value;
+        }
+
+        return i;
+    }
+#endif
+
     template <typename ClassType>
     class MinMax
     {
@@ -40,6 +187,61 @@ namespace maxssau
             }
         }
 
+        // Bulk update over count values, optionally split between threads (0 - all hardware threads)
+        void Calculate(const ClassType* data, size_t count, unsigned int threads = 1)
+        {
+            if (data == nullptr || count == 0)
+            {
+                return;
+            }
+
+            threads = GetThreadsCount(count, threads, ParallelMinChunk);
+
+            if (threads <= 1)
+            {
+                CalculateRange(data, count, MinValue, MaxValue);
+                return;
+            }
+
+            std::vector<MinMax> partial(threads);
+
+            ParallelFor(count, threads, [&](size_t begin, size_t end, unsigned int index)
+            {
+                CalculateRange(data + begin, end - begin, partial[index].MinValue, partial[index].MaxValue);
+            });
+
+            for (const auto& item : partial)
+            {
+                Merge(item);
+            }
+        }
+
+        void Calculate(const std::vector<ClassType>& data, unsigned int threads = 1)
+        {
+            Calculate(data.data(), data.size(), threads);
+        }
+
+        // Pointers and vector iterators of ClassType go to the bulk overload, other iterators are read one by one
+        template <typename Iterator>
+        void Calculate(Iterator first, Iterator last)
+        {
+            CalculateIterators(first, last, std::integral_constant<bool, IsContiguousIterator<Iterator>::value>());
+        }
+
+        // Combines extremes collected by another calculator (e.g. on another thread)
+        void Merge(const MinMax& other)
+        {
+            if (MinValue > other.MinValue)
+            {
+                MinValue = other.MinValue;
+            }
+
+            if (MaxValue < other.MaxValue)
+            {
+                MaxValue = other.MaxValue;
+            }
+        }
+
         void SetMaxValue(ClassType value)
         {
             MaxValue = value;
@@ -61,10 +263,675 @@ namespace maxssau
         }
 
     private:
+        static constexpr size_t ParallelMinChunk = 1 << 18;
+        static constexpr size_t Lanes = 16;
+
+        template <typename Iterator> struct IsContiguousIterator
+        {
+            static constexpr bool value = std::is_same<Iterator, ClassType*>::value ||
+                std::is_same<Iterator, const ClassType*>::value ||
+                std::is_same<Iterator, typename std::vector<ClassType>::iterator>::value ||
+                std::is_same<Iterator, typename std::vector<ClassType>::const_iterator>::value;
+        };
+
+        template <typename Iterator>
+        void CalculateIterators(Iterator first, Iterator last, std::true_type)
+        {
+            if (first != last)
+            {
+                Calculate(&*first, (size_t)(last - first));
+            }
+        }
+
+        template <typename Iterator>
+        void CalculateIterators(Iterator first, Iterator last, std::false_type)
+        {
+            for (; first != last; ++first)
+            {
+                Calculate(static_cast<ClassType>(*first));
+            }
+        }
+
+        // With AVX2 MinMaxRangeAVX2 takes the 8/16/32-bit integer and floating types and leaves a short tail.
+        // Otherwise integer types use one accumulator: gcc 12 vectorizes that min/max reduction at -O3, at -O2
+        // it may stay scalar cmov. Floating types use independent lanes without data dependencies between
+        // them, since a floating min/max reduction is vectorized only with -ffast-math
+        static void CalculateRange(const ClassType* data, size_t count, ClassType& min_value, ClassType& max_value)
+        {
+            size_t i = 0;
+
+#if defined(__AVX2__)
+            i = CalculateRangeAVX2(data, count, min_value, max_value,
+                std::integral_constant<bool, MinMaxAVX2<ClassType>::Supported>());
+#endif
+
+            if (std::is_integral<ClassType>::value)
+            {
+                ClassType low = min_value;
+                ClassType high = max_value;
+
+                for (; i < count; i++)
+                {
+                    ClassType value = data[i];
+
+                    low = value < low ? value : low;
+                    high = high < value ? value : high;
+                }
+
+                min_value = low;
+                max_value = high;
+                return;
+            }
+
+            ClassType lane_min[Lanes];
+            ClassType lane_max[Lanes];
+
+            for (size_t l = 0; l < Lanes; l++)
+            {
+                lane_min[l] = min_value;
+                lane_max[l] = max_value;
+            }
+
+            for (; i + Lanes <= count; i += Lanes)
+            {
+                for (size_t l = 0; l < Lanes; l++)
+                {
+                    ClassType value = data[i + l];
+
+                    lane_min[l] = value < lane_min[l] ? value : lane_min[l];
+                    lane_max[l] = lane_max[l] < value ? value : lane_max[l];
+                }
+            }
+
+            for (const ClassType* tail = data + i; tail != data + count; tail++)
+            {
+                ClassType value = *tail;
+
+                lane_min[0] = value < lane_min[0] ? value : lane_min[0];
+                lane_max[0] = lane_max[0] < value ? value : lane_max[0];
+            }
+
+            for (size_t l = 0; l < Lanes; l++)
+            {
+                if (min_value > lane_min[l])
+                {
+                    min_value = lane_min[l];
+                }
+
+                if (max_value < lane_max[l])
+                {
+                    max_value = lane_max[l];
+                }
+            }
+        }
+
+#if defined(__AVX2__)
+        static size_t CalculateRangeAVX2(const ClassType* data, size_t count, ClassType& min_value, ClassType& max_value,
+            std::true_type)
+        {
+            return MinMaxRangeAVX2(data, count, min_value, max_value);
+        }
+
+        static size_t CalculateRangeAVX2(const ClassType*, size_t, ClassType&, ClassType&, std::false_type)
+        {
+            return 0;
+        }
+#endif
+
         ClassType MinValue;
         ClassType MaxValue;
     };
 
+    // Monotonic queues of (key, value): front of each queue is the extreme of the window,
+    // every value is pushed and evicted once, so updates are O(1) amortized
+    template <typename ClassType, typename KeyType>
+    class MonotonicWindow
+    {
+    public:
+        void Push(KeyType key, ClassType value)
+        {
+            while (!MaxQueue.empty() && MaxQueue.back().Value <= value)
+            {
+                MaxQueue.pop_back();
+            }
+            MaxQueue.push_back({key, value});
+
+            while (!MinQueue.empty() && MinQueue.back().Value >= value)
+            {
+                MinQueue.pop_back();
+            }
+            MinQueue.push_back({key, value});
+        }
+
+        // Drops all samples with key < oldest_key
+        void Evict(KeyType oldest_key)
+        {
+            while (!MaxQueue.empty() && MaxQueue.front().Key < oldest_key)
+            {
+                MaxQueue.pop_front();
+            }
+
+            while (!MinQueue.empty() && MinQueue.front().Key < oldest_key)
+            {
+                MinQueue.pop_front();
+            }
+        }
+
+        bool IsEmpty() const
+        {
+            return MaxQueue.empty();
+        }
+
+        ClassType GetMaxValue() const
+        {
+            return MaxQueue.empty() ? std::numeric_limits<ClassType>::lowest() : MaxQueue.front().Value;
+        }
+
+        ClassType GetMinValue() const
+        {
+            return MinQueue.empty() ? std::numeric_limits<ClassType>::max() : MinQueue.front().Value;
+        }
+
+        void Reset()
+        {
+            MaxQueue.clear();
+            MinQueue.clear();
+        }
+
+    private:
+        struct Sample
+        {
+            KeyType Key;
+            ClassType Value;
+        };
+
+        std::deque<Sample> MaxQueue;
+        std::deque<Sample> MinQueue;
+    };
+
+    // Extremes over the last window_size samples
+    template <typename ClassType>
+    class WindowMinMax
+    {
+    public:
+        WindowMinMax(size_t window_size)
+        {
+            WindowSize = window_size == 0 ? 1 : window_size;
+            Reset();
+        }
+
+        ClassType GetMaxValue() const
+        {
+            return Window.GetMaxValue();
+        }
+
+        ClassType GetMinValue() const
+        {
+            return Window.GetMinValue();
+        }
+
+        void Calculate(ClassType value)
+        {
+            Window.Push(Counter, value);
+            Counter++;
+
+            if (Counter > WindowSize)
+            {
+                Window.Evict(Counter - WindowSize);
+            }
+        }
+
+        void Calculate(const ClassType* data, size_t count)
+        {
+            // only the last window_size values can survive
+            if (count > WindowSize)
+            {
+                Counter += count - WindowSize;
+                data += count - WindowSize;
+                count = WindowSize;
+            }
+
+            for (size_t i = 0; i < count; i++)
+            {
+                Calculate(data[i]);
+            }
+        }
+
+        size_t GetWindowSize() const
+        {
+            return WindowSize;
+        }
+
+        void Reset()
+        {
+            Window.Reset();
+            Counter = 0;
+        }
+
+    private:
+        MonotonicWindow<ClassType, size_t> Window;
+        size_t WindowSize;
+        size_t Counter;
+    };
+
+    // Extremes over the samples of the last window_time time units,
+    // timestamps passed to Calculate must not decrease
+    template <typename ClassType, typename TimeType = double>
+    class TimeWindowMinMax
+    {
+    public:
+        TimeWindowMinMax(TimeType window_time)
+        {
+            WindowTime = window_time;
+            Reset();
+        }
+
+        ClassType GetMaxValue() const
+        {
+            return Window.GetMaxValue();
+        }
+
+        ClassType GetMinValue() const
+        {
+            return Window.GetMinValue();
+        }
+
+        void Calculate(ClassType value, TimeType time)
+        {
+            Window.Push(time, value);
+            Update(time);
+        }
+
+        // Evicts expired samples without adding a new one (e.g. on dashboard refresh)
+        void Update(TimeType time)
+        {
+            // an unsigned difference would wrap before the first WindowTime has passed
+            Window.Evict(time > WindowTime || std::is_signed<TimeType>::value ? time - WindowTime : TimeType(0));
+        }
+
+        TimeType GetWindowTime() const
+        {
+            return WindowTime;
+        }
+
+        void Reset()
+        {
+            Window.Reset();
+        }
+
+    private:
+        MonotonicWindow<ClassType, TimeType> Window;
+        TimeType WindowTime;
+    };
+
+    // Exponentially decayed extremes: after each step the stored extreme relaxes towards
+    // the new sample by factor (1-decay), so old peaks fade out instead of being kept forever.
+    // decay=1 gives all-time extremes like MinMax
+    template <typename ClassType>
+    class DecayMinMax
+    {
+    public:
+        DecayMinMax(double decay)
+        {
+            Decay = decay;
+            Reset();
+        }
+
+        ClassType GetMaxValue() const
+        {
+            return Initialized ? ToValue(MaxValue, std::is_integral<ClassType>()) : std::numeric_limits<ClassType>::lowest();
+        }
+
+        ClassType GetMinValue() const
+        {
+            return Initialized ? ToValue(MinValue, std::is_integral<ClassType>()) : std::numeric_limits<ClassType>::max();
+        }
+
+        void Calculate(ClassType value)
+        {
+            Update(static_cast<double>(value), Decay);
+        }
+
+        // Irregular sampling: elapsed is measured in the units the decay factor is given for
+        void Calculate(ClassType value, double elapsed)
+        {
+            Update(static_cast<double>(value), std::pow(Decay, elapsed));
+        }
+
+        void Reset()
+        {
+            Initialized = false;
+            MinValue = 0;
+            MaxValue = 0;
+        }
+
+    private:
+        // Integral types: the decayed state is rounded to the nearest value and clamped to the type range
+        // (std::round instead of std::lround, which overflows long for 64-bit unsigned types)
+        static ClassType ToValue(double value, std::true_type)
+        {
+            value = std::round(value);
+
+            if (value <= static_cast<double>(std::numeric_limits<ClassType>::lowest()))
+            {
+                return std::numeric_limits<ClassType>::lowest();
+            }
+
+            if (value >= static_cast<double>(std::numeric_limits<ClassType>::max()))
+            {
+                return std::numeric_limits<ClassType>::max();
+            }
+
+            return static_cast<ClassType>(value);
+        }
+
+        static ClassType ToValue(double value, std::false_type)
+        {
+            return static_cast<ClassType>(value);
+        }
+
+        void Update(double value, double factor)
+        {
+            if (!Initialized)
+            {
+                MinValue = value;
+                MaxValue = value;
+                Initialized = true;
+                return;
+            }
+
+            MaxValue = value + (MaxValue - value) * factor;
+            MinValue = value + (MinValue - value) * factor;
+
+            if (MaxValue < value)
+            {
+                MaxValue = value;
+            }
+
+            if (MinValue > value)
+            {
+                MinValue = value;
+            }
+        }
+
+        double Decay;
+        double MinValue;
+        double MaxValue;
+        bool Initialized;
+    };
+
+    template <typename ClassType>
+    struct IndexedValue
+    {
+        ClassType Value;
+        size_t Index;
+    };
+
+    // MinMax which also keeps positions of the extremes (first occurrence wins).
+    // Without explicit index values are numbered in order of arrival
+    template <typename ClassType>
+    class IndexedMinMax
+    {
+    public:
+        IndexedMinMax()
+        {
+            Reset();
+        }
+
+        ClassType GetMaxValue() const
+        {
+            return MaxValue.Value;
+        }
+
+        ClassType GetMinValue() const
+        {
+            return MinValue.Value;
+        }
+
+        size_t GetMaxIndex() const
+        {
+            return MaxValue.Index;
+        }
+
+        size_t GetMinIndex() const
+        {
+            return MinValue.Index;
+        }
+
+        size_t GetCount() const
+        {
+            return Counter;
+        }
+
+        void Calculate(ClassType value)
+        {
+            Calculate(value, Counter);
+        }
+
+        void Calculate(ClassType value, size_t index)
+        {
+            Update({value, index}, {value, index});
+            Counter++;
+        }
+
+        // Bulk update, data[i] gets index GetCount()+i
+        void Calculate(const ClassType* data, size_t count, unsigned int threads = 1)
+        {
+            if (data == nullptr || count == 0)
+            {
+                return;
+            }
+
+            threads = GetThreadsCount(count, threads, ParallelMinChunk);
+
+            std::vector<IndexedMinMax> partial(threads);
+            size_t base = Counter;
+
+            ParallelFor(count, threads, [&](size_t begin, size_t end, unsigned int index)
+            {
+                partial[index].CalculateRange(data, begin, end, base);
+            });
+
+            for (const auto& item : partial)
+            {
+                Update(item.MinValue, item.MaxValue);
+            }
+
+            Counter += count;
+        }
+
+        void Merge(const IndexedMinMax& other)
+        {
+            Update(other.MinValue, other.MaxValue);
+            Counter += other.Counter;
+        }
+
+        void Reset()
+        {
+            MinValue = {std::numeric_limits<ClassType>::max(), std::numeric_limits<size_t>::max()};
+            MaxValue = {std::numeric_limits<ClassType>::lowest(), std::numeric_limits<size_t>::max()};
+            Counter = 0;
+        }
+
+    private:
+        static constexpr size_t ParallelMinChunk = 1 << 18;
+        static constexpr size_t BlockSize = 4096;
+
+        void Update(const IndexedValue<ClassType>& min_value, const IndexedValue<ClassType>& max_value)
+        {
+            if (min_value.Value < MinValue.Value || (min_value.Value == MinValue.Value && min_value.Index < MinValue.Index))
+            {
+                MinValue = min_value;
+            }
+
+            if (max_value.Value > MaxValue.Value || (max_value.Value == MaxValue.Value && max_value.Index < MaxValue.Index))
+            {
+                MaxValue = max_value;
+            }
+        }
+
+        // Per block: vectorized extremes first, positions are searched only
+        // in blocks which improve the result
+        void CalculateRange(const ClassType* data, size_t begin, size_t end, size_t base)
+        {
+            for (size_t block = begin; block < end; block += BlockSize)
+            {
+                size_t length = end - block < BlockSize ? end - block : BlockSize;
+                const ClassType* values = data + block;
+
+                MinMax<ClassType> extremes;
+                extremes.Calculate(values, length);
+
+                ClassType min_value = extremes.GetMinValue();
+                ClassType max_value = extremes.GetMaxValue();
+
+                // the first block always sets the index: a frame of only max() or lowest() never beats the sentinels
+                if (min_value < MinValue.Value || MinValue.Index == std::numeric_limits<size_t>::max())
+                {
+                    MinValue.Value = min_value;
+                    MinValue.Index = base + block + (std::find(values, values + length, min_value) - values);
+                }
+
+                if (max_value > MaxValue.Value || MaxValue.Index == std::numeric_limits<size_t>::max())
+                {
+                    MaxValue.Value = max_value;
+                    MaxValue.Index = base + block + (std::find(values, values + length, max_value) - values);
+                }
+            }
+        }
+
+        IndexedValue<ClassType> MinValue;
+        IndexedValue<ClassType> MaxValue;
+        size_t Counter;
+    };
+
+    // k largest (largest=true) or smallest values with their positions,
+    // sorted from the most extreme one; equal values are ordered by position.
+    // Small k: bounded heap per thread, blocks which can not enter the heap are
+    // rejected by a vectorized min/max check. Large k: nth_element per thread.
+    // Partial results of the threads are merged with one more selection.
+    // NaNs are ordered after all other values in both directions, so they are selected
+    // only when there are fewer than k other values.
+    template <typename ClassType>
+    std::vector<IndexedValue<ClassType>> SelectTopK(const ClassType* data, size_t count, size_t k,
+        bool largest = true, unsigned int threads = 1)
+    {
+        std::vector<IndexedValue<ClassType>> result;
+
+        if (data == nullptr || count == 0 || k == 0)
+        {
+            return result;
+        }
+
+        k = k < count ? k : count;
+
+        auto better = [largest](const IndexedValue<ClassType>& a, const IndexedValue<ClassType>& b)
+        {
+            bool a_nan = a.Value != a.Value;
+            bool b_nan = b.Value != b.Value;
+
+            if (a_nan || b_nan)
+            {
+                return a_nan == b_nan ? a.Index < b.Index : b_nan;
+            }
+
+            if (a.Value == b.Value)
+            {
+                return a.Index < b.Index;
+            }
+
+            return largest ? a.Value > b.Value : a.Value < b.Value;
+        };
+
+        constexpr size_t BlockSize = 1024;
+        threads = GetThreadsCount(count, threads, 1 << 18);
+
+        std::vector<std::vector<IndexedValue<ClassType>>> partial(threads);
+
+        ParallelFor(count, threads, [&](size_t begin, size_t end, unsigned int index)
+        {
+            std::vector<IndexedValue<ClassType>>& selected = partial[index];
+            size_t length = end - begin;
+
+            if (k * 16 >= length)
+            {
+                selected.resize(length);
+                for (size_t i = 0; i < length; i++)
+                {
+                    selected[i] = {data[begin + i], begin + i};
+                }
+
+                if (k < length)
+                {
+                    std::nth_element(selected.begin(), selected.begin() + k, selected.end(), better);
+                    selected.resize(k);
+                }
+
+                return;
+            }
+
+            // heap front is the worst of the selected values
+            selected.reserve(k);
+
+            for (size_t block = begin; block < end; block += BlockSize)
+            {
+                size_t block_end = end - block < BlockSize ? end : block + BlockSize;
+
+                if (selected.size() == k)
+                {
+                    MinMax<ClassType> extremes;
+                    extremes.Calculate(data + block, block_end - block);
+
+                    // MinMax skips NaNs, and any other value of the block beats a NaN at the front
+                    ClassType worst = selected.front().Value;
+
+                    if (worst == worst && (largest ? !(extremes.GetMaxValue() > worst) : !(extremes.GetMinValue() < worst)))
+                    {
+                        continue;
+                    }
+                }
+
+                for (size_t i = block; i < block_end; i++)
+                {
+                    IndexedValue<ClassType> item = {data[i], i};
+
+                    if (selected.size() < k)
+                    {
+                        selected.push_back(item);
+                        std::push_heap(selected.begin(), selected.end(), better);
+                    }
+                    else if (better(item, selected.front()))
+                    {
+                        std::pop_heap(selected.begin(), selected.end(), better);
+                        selected.back() = item;
+                        std::push_heap(selected.begin(), selected.end(), better);
+                    }
+                }
+            }
+        });
+
+        for (auto& item : partial)
+        {
+            result.insert(result.end(), item.begin(), item.end());
+        }
+
+        if (result.size() > k)
+        {
+            std::nth_element(result.begin(), result.begin() + k, result.end(), better);
+            result.resize(k);
+        }
+
+        std::sort(result.begin(), result.end(), better);
+
+        return result;
+    }
+
+    template <typename ClassType>
+    std::vector<IndexedValue<ClassType>> SelectBottomK(const ClassType* data, size_t count, size_t k, unsigned int threads = 1)
+    {
+        return SelectTopK(data, count, k, false, threads);
+    }
+
 }
 
 #endif
\ No newline at end of file
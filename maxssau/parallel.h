@@ -0,0 +1,81 @@
+#ifndef __parallel__
+#define __parallel__
+
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace maxssau
+{
+    inline unsigned int GetHardwareThreads()
+    {
+        unsigned int count = std::thread::hardware_concurrency();
+
+        return count == 0 ? 1 : count;
+    }
+
+    // Number of threads worth starting for count elements:
+    // threads=0 means "all hardware threads", every thread gets at least min_chunk elements
+    inline unsigned int GetThreadsCount(size_t count, unsigned int threads, size_t min_chunk)
+    {
+        if (threads == 0)
+        {
+            threads = GetHardwareThreads();
+        }
+
+        if (min_chunk == 0)
+        {
+            min_chunk = 1;
+        }
+
+        size_t useful = count / min_chunk;
+
+        if (useful < threads)
+        {
+            threads = (unsigned int)useful;
+        }
+
+        return threads == 0 ? 1 : threads;
+    }
+
+    // Splits [0, count) into threads contiguous ranges and calls function(begin, end, thread_index)
+    // for each of them. The calling thread processes the first range itself.
+    template <typename Function>
+    void ParallelFor(size_t count, unsigned int threads, Function function)
+    {
+        if (threads <= 1 || count <= 1)
+        {
+            function((size_t)0, count, 0u);
+            return;
+        }
+
+        if (threads > count)
+        {
+            threads = (unsigned int)count;
+        }
+
+        std::vector<std::thread> workers;
+        workers.reserve(threads - 1);
+
+        size_t chunk = count / threads;
+        size_t rest = count % threads;
+        size_t begin = chunk + (rest > 0 ? 1 : 0);
+
+        for (unsigned int i = 1; i < threads; i++)
+        {
+            size_t end = begin + chunk + (i < rest ? 1 : 0);
+
+            workers.emplace_back(function, begin, end, i);
+            begin = end;
+        }
+
+        function((size_t)0, chunk + (rest > 0 ? 1 : 0), 0u);
+
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+    }
+}
+
+#endif
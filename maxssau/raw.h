@@ -1,22 +1,30 @@
 #ifndef __raw__
 #define __raw__
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
 #include "enums.h"
 #include "cubic_interpolate.h"
+#include "demosaic.h"
+#include "raw_file.h"
 #include "matrix.h"
+#include "minmax.h"
+#include "parallel.h"
 
 namespace maxssau
 {
-	enum DemosaicMode
-	{
-		FullColor=0
-	}
-
-
 	template <typename Type>struct ColorMatrix
 	{
 		Type Values[3][3];
-	}
+	};
 
     template <typename Type>struct MinMaxValues
     {
@@ -31,6 +39,301 @@ namespace maxssau
         MinMaxValues<Type> B;
     };
 
+	// Per-channel statistics of a Bayer mosaic, indexed by BayerChannel
+	template <typename Type>struct BayerStatistics
+	{
+		MinMaxValues<Type>		Channel[4];
+		std::vector<uint64_t>	Histogram[4];
+		Type					HistogramMax;
+
+		RGBMinMaxValues<Type> GetRGBMinMax() const
+		{
+			RGBMinMaxValues<Type> result;
+
+			result.R=Channel[ChannelR];
+			result.B=Channel[ChannelB];
+			result.G.Min=Channel[ChannelG1].Min<Channel[ChannelG2].Min ? Channel[ChannelG1].Min : Channel[ChannelG2].Min;
+			result.G.Max=Channel[ChannelG1].Max>Channel[ChannelG2].Max ? Channel[ChannelG1].Max : Channel[ChannelG2].Max;
+
+			return result;
+		}
+
+		MinMaxValues<Type> GetMinMax() const
+		{
+			MinMaxValues<Type> result=Channel[0];
+
+			for(unsigned int c=1;c<4;c++)
+			{
+				result.Min=Channel[c].Min<result.Min ? Channel[c].Min : result.Min;
+				result.Max=Channel[c].Max>result.Max ? Channel[c].Max : result.Max;
+			}
+
+			return result;
+		}
+	};
+
+	// Min/max of one mosaic row into the extremes of its channels: c0 - even columns, c1 - odd columns
+	template <typename Type>
+	void AccumulateBayerRow(const Type* row, unsigned int width, unsigned int c0, unsigned int c1, MinMax<Type> extremes[4])
+	{
+		Type min0=std::numeric_limits<Type>::max(), max0=std::numeric_limits<Type>::lowest();
+		Type min1=min0, max1=max0;
+
+		unsigned int x=0;
+		for(;x+1<width;x+=2)
+		{
+			Type v0=row[x];
+			Type v1=row[x+1];
+
+			min0=v0<min0 ? v0 : min0;
+			max0=max0<v0 ? v0 : max0;
+			min1=v1<min1 ? v1 : min1;
+			max1=max1<v1 ? v1 : max1;
+		}
+
+		if(x<width)
+		{
+			min0=row[x]<min0 ? row[x] : min0;
+			max0=max0<row[x] ? row[x] : max0;
+		}
+
+		extremes[c0].Calculate(min0);
+		extremes[c0].Calculate(max0);
+
+		if(width>1)
+		{
+			extremes[c1].Calculate(min1);
+			extremes[c1].Calculate(max1);
+		}
+	}
+
+	// One pass over a Bayer mosaic: per-channel min/max and, if histogram_bins>0,
+	// per-channel histograms of [0, histogram_max]. Row bands are processed on threads
+	// (0 - all hardware threads) with private accumulators merged at the end.
+	template <typename Type>
+	int CalculateBayerStatistics(const Type* input, unsigned int height, unsigned int width, unsigned int pattern,
+		BayerStatistics<Type>& result, unsigned int histogram_bins=0,
+		Type histogram_max=std::numeric_limits<Type>::max(), unsigned int threads=1)
+	{
+		if(input==nullptr || height==0 || width==0)
+		{
+			return STATUS_FAIL;
+		}
+
+		struct Partial
+		{
+			MinMax<Type> Extremes[4];
+			std::vector<uint64_t> Histogram[4];
+		};
+
+		// threads split row pairs, each gets at least 2^18 pixels
+		unsigned int row_pairs=(height+1)/2;
+		size_t pairs_per_thread=((size_t)(1 << 18)+2*(size_t)width-1)/(2*(size_t)width);
+		threads=GetThreadsCount(row_pairs, threads, pairs_per_thread);
+
+		std::vector<Partial> partial(threads);
+		double bin_scale=histogram_max>0 ? (double)histogram_bins/(double)histogram_max : 0.0;
+
+		for(auto& local : partial)
+		{
+			for(unsigned int c=0;c<4;c++)
+			{
+				local.Histogram[c].assign(histogram_bins, 0);
+			}
+		}
+
+		ParallelFor(row_pairs, threads, [&](size_t begin, size_t end, unsigned int index)
+		{
+			Partial& local=partial[index];
+
+			for(size_t y=begin*2;y<end*2 && y<height;y++)
+			{
+				const Type* row=input+y*width;
+				unsigned int c0=GetBayerChannel(pattern, 0, (unsigned int)y);
+				unsigned int c1=GetBayerChannel(pattern, 1, (unsigned int)y);
+
+				AccumulateBayerRow(row, width, c0, c1, local.Extremes);
+
+				if(histogram_bins>0)
+				{
+					uint64_t* h0=local.Histogram[c0].data();
+					uint64_t* h1=local.Histogram[c1].data();
+
+					for(unsigned int x=0;x<width;x++)
+					{
+						double position=(double)row[x]*bin_scale;
+						size_t bin=position<=0.0 ? 0 : (size_t)position;
+
+						bin=bin<histogram_bins ? bin : histogram_bins-1;
+						((x & 1) ? h1 : h0)[bin]++;
+					}
+				}
+			}
+		});
+
+		result.HistogramMax=histogram_max;
+
+		for(unsigned int c=0;c<4;c++)
+		{
+			MinMax<Type> extremes;
+
+			result.Histogram[c].assign(histogram_bins, 0);
+
+			for(auto& local : partial)
+			{
+				extremes.Merge(local.Extremes[c]);
+
+				for(unsigned int b=0;b<histogram_bins;b++)
+				{
+					result.Histogram[c][b]+=local.Histogram[c][b];
+				}
+			}
+
+			result.Channel[c].Min=extremes.GetMinValue();
+			result.Channel[c].Max=extremes.GetMaxValue();
+		}
+
+		return STATUS_OK;
+	}
+
+	// UnpackFrame with the per-channel min/max of every row collected while the row is still in cache
+	// (result has no histograms). Rows are unpacked by threads in bands
+	template <typename Type>
+	int UnpackBayerFrame(unsigned int format, const uint8_t* data, size_t row_stride, unsigned int height, unsigned int width,
+		unsigned int pattern, Type* output, BayerStatistics<Type>& result, unsigned int threads=1)
+	{
+		if(data==nullptr || output==nullptr || height==0 || width==0 || GetPackedBits(format)==0 ||
+			row_stride<GetPackedRowBytes(format, width))
+		{
+			return STATUS_FAIL;
+		}
+
+		threads=GetThreadsCount((size_t)height*width, threads, 1 << 18);
+		std::vector<std::vector<MinMax<Type>>> partial(threads, std::vector<MinMax<Type>>(4));
+
+		ParallelFor(height, threads, [&](size_t begin, size_t end, unsigned int index)
+		{
+			for(size_t y=begin;y<end;y++)
+			{
+				Type* row=output+y*width;
+
+				UnpackRow(format, data+y*row_stride, 0, width, row);
+				AccumulateBayerRow((const Type*)row, width, GetBayerChannel(pattern, 0, (unsigned int)y),
+					GetBayerChannel(pattern, 1, (unsigned int)y), partial[index].data());
+			}
+		});
+
+		result.HistogramMax=0;
+
+		for(unsigned int c=0;c<4;c++)
+		{
+			MinMax<Type> extremes;
+
+			for(auto& local : partial)
+			{
+				extremes.Merge(local[c]);
+			}
+
+			result.Histogram[c].clear();
+			result.Channel[c].Min=extremes.GetMinValue();
+			result.Channel[c].Max=extremes.GetMaxValue();
+		}
+
+		return STATUS_OK;
+	}
+
+	// Black level subtraction, normalization, white balance and colour matrix folded into one affine transform:
+	// before demosaic every Bayer channel c becomes value*InputGain[c]+InputOffset[c], after demosaic
+	// rgb=Matrix*rgb+Bias. A demosaic that builds every colour only from samples of that colour (bilinear)
+	// commutes with the per-channel part, so with fold it moves into Matrix and Bias and loading is a plain
+	// conversion; cross-channel demosaics keep the black level and white balance before demosaic.
+	struct RawColorTransform
+	{
+		float	InputGain[4];
+		float	InputOffset[4];
+		float	Matrix[3][3];
+		float	Bias[3];
+		bool	UseMatrix;		// false for the identity transform after demosaic
+	};
+
+	// black - per BayerChannel, gains - R, G, B white balance, matrix - camera RGB -> output RGB
+	inline int BuildRawColorTransform(const float black[4], float white, const float gains[3], const float matrix[3][3],
+		bool fold, RawColorTransform& transform)
+	{
+		static const unsigned int colour[4]={0, 1, 1, 2};
+		float scale[4];
+
+		for(unsigned int c=0;c<4;c++)
+		{
+			if(!(white>black[c]))
+			{
+				return STATUS_FAIL;
+			}
+
+			scale[c]=gains[colour[c]]/(white-black[c]);
+		}
+
+		// green channels must share the transform to fold it
+		fold=fold && black[ChannelG1]==black[ChannelG2];
+
+		for(unsigned int c=0;c<4;c++)
+		{
+			transform.InputGain[c]=fold ? 1.0f : scale[c];
+			transform.InputOffset[c]=fold ? 0.0f : -black[c]*scale[c];
+		}
+
+		static const unsigned int site[3]={ChannelR, ChannelG1, ChannelB};
+		transform.UseMatrix=false;
+
+		for(unsigned int i=0;i<3;i++)
+		{
+			transform.Bias[i]=0.0f;
+
+			for(unsigned int k=0;k<3;k++)
+			{
+				transform.Matrix[i][k]=fold ? matrix[i][k]*scale[site[k]] : matrix[i][k];
+
+				if(fold)
+				{
+					transform.Bias[i]-=transform.Matrix[i][k]*black[site[k]];
+				}
+
+				transform.UseMatrix=transform.UseMatrix || transform.Matrix[i][k]!=(i==k ? 1.0f : 0.0f);
+			}
+
+			transform.UseMatrix=transform.UseMatrix || transform.Bias[i]!=0.0f;
+		}
+
+		return STATUS_OK;
+	}
+
+	// Standard transfer curves of raw_converter, applied when use_gammacurve is set and use_gammacurve_user is not
+	enum ToneCurve
+	{
+		ToneCurveSRGB=0,
+		ToneCurveRec709=1
+	};
+
+	// Encoded value of a linear value in [0, 1]
+	inline double GetToneCurveValue(unsigned int curve, double value)
+	{
+		if(curve==ToneCurveRec709)
+		{
+			return value<0.018 ? 4.5*value : 1.099*std::pow(value, 0.45)-0.099;
+		}
+
+		return value<=0.0031308 ? 12.92*value : 1.055*std::pow(value, 1.0/2.4)-0.055;
+	}
+
+	// White balance estimators of raw_converter, used when use_white_balance is set and use_white_balance_user is not
+	enum WhiteBalanceMode
+	{
+		WhiteBalanceNone=0,				// no estimation, white_balance_coeff as set
+		WhiteBalanceGrayWorld=1,		// equal channel means
+		WhiteBalanceWhitePatch=2,		// equal channel maxima
+		WhiteBalancePercentile=3		// equal channel values at the white_balance_target percentile
+	};
+
 	typedef struct raw_converter_settings
 	{
 		bool use_colormatrix;
@@ -40,26 +343,45 @@ namespace maxssau
 		bool use_gammacurve_user;
 		bool normalize_input_data;
 		unsigned int demosaic_mode;
-	};
+		unsigned int bayer_pattern;
+		unsigned int tone_curve;
+		unsigned int white_balance_mode;
+	} raw_converter_settings;
     
 
     template <typename TypeInputData, typename TypeOutputData> class raw_converter
     {
         public:
 			raw_converter_settings 				settings;
-			Matrix<TypeOutputData>				color_matrix;
-			CubicInterpolator<TypeOutputData>	gamma_curve_user;
+			Matrix<float>						color_matrix;			// camera RGB -> output RGB, 3x3
+			CubicInterpolator<float>			gamma_curve_user;		// linear [0, 1] -> encoded [0, 1]
 
-			unsigned int 						white_balance_target;
-			Matrix<TypeOutputData>				white_balance_coeff;
+			unsigned int 						white_balance_target;	// percentile of WhiteBalancePercentile, 0 - 99
+			Matrix<float>						white_balance_coeff;	// R, G, B gains without an estimator or with use_white_balance_user, 3x1
 
-            raw_converter()
+			TypeInputData						black_level[4];			// per BayerChannel, when normalize_input_data is off
+
+            raw_converter() : color_matrix(Matrix<float>::identity(3)), white_balance_coeff(3, 1, 1.0f)
             {
 				settings.use_colormatrix=true;
 				settings.use_gammacurve=true;
 				settings.use_white_balance=true;
+				settings.use_white_balance_user=false;
+				settings.use_gammacurve_user=false;
+				settings.normalize_input_data=false;
+				settings.demosaic_mode=FullColor;
+				settings.bayer_pattern=BayerRGGB;
+				settings.tone_curve=ToneCurveSRGB;
+				settings.white_balance_mode=WhiteBalanceNone;
+
+				white_balance_target=0;
+
+				for(unsigned int c=0;c<4;c++)
+				{
+					black_level[c]=0;
+				}
 
-				constexpr ClassType max = std::numeric_limits<ClassType>::max();
+				constexpr TypeInputData max = std::numeric_limits<TypeInputData>::max();
 				InputDataMaximum=max;
             };
 
@@ -68,26 +390,1222 @@ namespace maxssau
                 
             }
 
+			// Per-channel min/max (and histograms) of the input mosaic, e.g. to feed Process
+			int CalculateStatistics(const TypeInputData *input, unsigned int height, unsigned int width,
+				BayerStatistics<TypeInputData>& result, unsigned int histogram_bins=0, unsigned int threads=1)
+			{
+				return CalculateBayerStatistics(input, height, width, settings.bayer_pattern, result, histogram_bins, InputDataMaximum, threads);
+			}
+
 			unsigned int GetIndexInputData(unsigned int x, unsigned int y, unsigned int width)
 			{
 				return y*width+x;
 			}
 
-			Matrix<TypeOutputData> Get_RGB_RAW_Data(unsigned int x, unsigned int y)
+			// White balance gains (R, G, B with G=1, 3x1) by settings.white_balance_mode (gray world for
+			// WhiteBalanceNone) from a statistics pass over
+			// every WhiteBalanceStep-th Bayer quad: quads with a clipped channel are skipped, the rest give per-channel
+			// sums, maxima and histograms of black-subtracted normalized values, collected by threads in row bands.
+			// Fails for a frame without usable quads
+			int EstimateWhiteBalance(const TypeInputData *input, MinMaxValues<TypeInputData> MinMax, unsigned int height,
+				unsigned int width, Matrix<float>& gains, unsigned int threads=1, unsigned int input_bits=0)
 			{
+				float result[3];
+
+				if(input==nullptr || EstimateGains(FrameRows{input, width}, MinMax, height, width, input_bits, result, threads)!=STATUS_OK)
+				{
+					return STATUS_FAIL;
+				}
+
+				gains=Matrix<float>(3, 1);
+
+				for(unsigned int c=0;c<3;c++)
+				{
+					gains(c, 0)=result[c];
+				}
 
+				return STATUS_OK;
 			}
 
-            int Process(TypeInputData *input, TypeOutputData *output,MinMaxValues<TypeInputData> MinMax, unsigned int height, unsigned int width)
+			// Demosaiced camera RGB of one pixel (normalized and balanced with white_balance_coeff, before the colour matrix
+			// and gamma) as a 3x1 matrix, computed with settings.demosaic_mode from the neighbourhood of (x, y)
+			Matrix<float> Get_RGB_RAW_Data(const TypeInputData *input, MinMaxValues<TypeInputData> MinMax,
+				unsigned int height, unsigned int width, unsigned int x, unsigned int y)
+			{
+				Matrix<float> result(3, 1);
+				PipelineParameters parameters;
+
+				if(input==nullptr || x>=width || y>=height || PrepareTransform(MinMax, false, parameters)!=STATUS_OK)
+				{
+					return result;
+				}
+
+				// 2x2 tile with even origin keeps the pattern of the frame
+				unsigned int x0=x & ~1u;
+				unsigned int y0=y & ~1u;
+				unsigned int tile_width=width-x0<2 ? width-x0 : 2;
+				unsigned int tile_height=height-y0<2 ? height-y0 : 2;
+				long stride=tile_width+2*TileBorder;
+
+				std::vector<float> mosaic(stride*(tile_height+2*TileBorder));
+				std::vector<float> planes(3*4);
+				std::vector<float> scratch(GetDemosaicScratchSize(2, 2));
+
+				LoadTile(FrameRows{input, width}, height, width, x0, y0, tile_width, tile_height, parameters, mosaic.data(), nullptr);
+				DemosaicTile(settings.demosaic_mode, mosaic.data()+TileBorder*stride+TileBorder, stride, tile_width, tile_height,
+					settings.bayer_pattern, planes.data(), planes.data()+4, planes.data()+8, 2, scratch.data());
+
+				for(unsigned int c=0;c<3;c++)
+				{
+					result(c, 0)=planes[c*4+(y-y0)*2+(x-x0)];
+				}
+
+				return result;
+			}
+
+			// Converts a Bayer mosaic (height x width) into interleaved RGB (height x width x 3).
+			// MinMax gives the black and white levels when settings.normalize_input_data is set,
+			// otherwise the input range is [0, InputDataMaximum]. Integer outputs span the whole type range,
+			// floating point outputs span [0, 1].
+			// The frame is split into tiles which threads (0 - all hardware threads) take from a shared counter;
+			// each tile is loaded with a border for demosaic into a private float buffer, demosaiced with
+			// settings.demosaic_mode into tile planes that fit L2, then the colour transform and the tone curve
+			// (a table of output values, see PipelineParameters) run row by row without intermediate frame buffers. Black level, normalization, white balance and
+			// colour matrix are one RawColorTransform: a multiply-add per pixel while loading and a 3x4 affine
+			// after demosaic, or only the affine for bilinear demosaic.
+			// White balance gains are white_balance_coeff unless settings.white_balance_mode selects an estimator,
+			// then (without settings.use_white_balance_user) they are estimated from the frame (EstimateWhiteBalance).
+			// input_bits - significant bits of unpacked packed data, which then give the white level instead of InputDataMaximum;
+			// more bits than TypeInputData holds give STATUS_FAIL
+            int Process(const TypeInputData *input, TypeOutputData *output, MinMaxValues<TypeInputData> MinMax,
+				unsigned int height, unsigned int width, unsigned int threads=1, unsigned int input_bits=0)
             {
+				if(input==nullptr || output==nullptr || height==0 || width==0)
+				{
+					return STATUS_FAIL;
+				}
+
+				PipelineParameters parameters;
+				float gains[3];
+
+				if(PrepareGains(FrameRows{input, width}, MinMax, height, width, input_bits, gains, threads)!=STATUS_OK ||
+					PreparePipeline(MinMax, parameters, input_bits, gains)!=STATUS_OK)
+				{
+					return STATUS_FAIL;
+				}
 
+				ProcessFrame(FrameRows{input, width}, output, height, width, parameters, threads);
 
                 return STATUS_OK;
             }
 
+			// Converts packed sensor data (height rows of row_stride bytes in PackedFormat) without an unpacked copy:
+			// every tile unpacks its own rows and columns right before they are loaded.
+			// The white level is the maximum of the packed bit depth unless settings.normalize_input_data is set
+			int ProcessPacked(const uint8_t *data, size_t row_stride, unsigned int format, TypeOutputData *output,
+				MinMaxValues<TypeInputData> MinMax, unsigned int height, unsigned int width, unsigned int threads=1)
+			{
+				unsigned int bits=GetPackedBits(format);
+
+				if(data==nullptr || output==nullptr || height==0 || width==0 || bits==0 ||
+					bits>(unsigned int)std::numeric_limits<TypeInputData>::digits || row_stride<GetPackedRowBytes(format, width))
+				{
+					return STATUS_FAIL;
+				}
+
+				PipelineParameters parameters;
+				PackedRows rows{data, row_stride, format};
+				float gains[3];
+
+				if(PrepareGains(rows, MinMax, height, width, bits, gains, threads)!=STATUS_OK ||
+					PreparePipeline(MinMax, parameters, bits, gains)!=STATUS_OK)
+				{
+					return STATUS_FAIL;
+				}
+
+				ProcessFrame(rows, output, height, width, parameters, threads);
+
+				return STATUS_OK;
+			}
+
+			// Unpacked sensor data of a file (height x width plane, e.g. for Process with several settings);
+			// with statistics the per-channel min/max are collected in the same pass.
+			// Fails without a layout or when TypeInputData has fewer bits than the packed samples
+			int Unpack(const RawFile& file, TypeInputData *output, BayerStatistics<TypeInputData>* statistics=nullptr,
+				unsigned int threads=1)
+			{
+				if(!file.HasLayout() || GetPackedBits(file.GetFormat())>(unsigned int)std::numeric_limits<TypeInputData>::digits)
+				{
+					return STATUS_FAIL;
+				}
+
+				if(statistics!=nullptr)
+				{
+					return UnpackBayerFrame(file.GetFormat(), file.GetRow(0), file.GetRowStride(), file.GetHeight(),
+						file.GetWidth(), settings.bayer_pattern, output, *statistics, threads);
+				}
+
+				return UnpackFrame(file.GetFormat(), file.GetRow(0), file.GetRowStride(), file.GetHeight(), file.GetWidth(),
+					output, threads);
+			}
+
+			// Converts the sensor data of a memory mapped file, read in place
+			int Process(const RawFile& file, TypeOutputData *output, MinMaxValues<TypeInputData> MinMax, unsigned int threads=1)
+			{
+				if(!file.HasLayout())
+				{
+					return STATUS_FAIL;
+				}
+
+				return ProcessPacked(file.GetRow(0), file.GetRowStride(), file.GetFormat(), output, MinMax,
+					file.GetHeight(), file.GetWidth(), threads);
+			}
+
+			// Size of a preview: every output pixel is a block of 2<<downscale x 2<<downscale input pixels,
+			// incomplete blocks at the right and bottom edges are dropped
+			static unsigned int GetPreviewSize(unsigned int size, unsigned int downscale)
+			{
+				return downscale<31 ? size/(2u<<downscale) : 0;
+			}
+
+			// Preview without demosaic: every Bayer quad is binned into one RGB pixel (R, the mean of both greens, B),
+			// downscale>0 averages further 2^downscale x 2^downscale quads. Output is interleaved RGB of
+			// GetPreviewSize(height) x GetPreviewSize(width) with the colour pipeline of Process (white balance,
+			// colour matrix and tone curve fold into one affine and the tone table). One pass over the input:
+			// output rows are split between threads, input rows are split into even and odd columns, summed
+			// pairwise and added into row accumulators. White balance estimation (white_balance_mode) reads
+			// only the sampled blocks before it and takes their binned values
+			int ProcessPreview(const TypeInputData *input, TypeOutputData *output, MinMaxValues<TypeInputData> MinMax,
+				unsigned int height, unsigned int width, unsigned int downscale=0, unsigned int threads=1, unsigned int input_bits=0)
+			{
+				if(input==nullptr)
+				{
+					return STATUS_FAIL;
+				}
+
+				return PreviewFrame(FrameRows{input, width}, output, MinMax, height, width, downscale, threads, input_bits);
+			}
+
+			// Preview of the sensor data of a memory mapped file: every row is unpacked into a buffer of the thread
+			// right before it is binned, there is no unpacked copy of the frame
+			int ProcessPreview(const RawFile& file, TypeOutputData *output, MinMaxValues<TypeInputData> MinMax,
+				unsigned int downscale=0, unsigned int threads=1)
+			{
+				unsigned int bits=GetPackedBits(file.GetFormat());
+
+				if(!file.HasLayout() || bits>(unsigned int)std::numeric_limits<TypeInputData>::digits)
+				{
+					return STATUS_FAIL;
+				}
+
+				return PreviewFrame(PackedRows{file.GetRow(0), file.GetRowStride(), file.GetFormat()}, output, MinMax,
+					file.GetHeight(), file.GetWidth(), downscale, threads, bits);
+			}
+
+			// Fills rows (count rows of width pixels), returns the number of rows read - less than count at the end of the image
+			typedef std::function<size_t(TypeInputData* rows, size_t count)> RowReader;
+			// Receives count converted rows (count x width x 3) starting at first_row
+			typedef std::function<void(const TypeOutputData* rows, size_t first_row, size_t count)> RowWriter;
+
+			// Streaming conversion of an image of any height: input rows are read into a ring of
+			// TileHeight+2*TileBorder rows (a strip and the demosaic border above and below it), every strip is
+			// converted by tiles on threads and passed to write. Memory does not depend on the image height,
+			// the height itself is known only when read returns fewer rows than requested.
+			// The frame is not available for estimation, so white balance always uses white_balance_coeff.
+			int ProcessStream(RowReader read, RowWriter write, MinMaxValues<TypeInputData> MinMax, unsigned int width,
+				unsigned int threads=1)
+			{
+				if(!read || !write || width==0)
+				{
+					return STATUS_FAIL;
+				}
+
+				PipelineParameters parameters;
+
+				if(PreparePipeline(MinMax, parameters)!=STATUS_OK)
+				{
+					return STATUS_FAIL;
+				}
+
+				const size_t ring_rows=TileHeight+2*TileBorder;
+				std::vector<TypeInputData> ring(ring_rows*width);
+				std::vector<TypeOutputData> strip((size_t)TileHeight*width*3);
+
+				size_t tiles=(width+TileWidth-1)/TileWidth;
+				threads=GetThreadsCount(tiles, threads, 1);
+				std::vector<TileBuffers> buffers(threads);
+
+				size_t loaded=0;
+				bool ended=false;
+
+				for(size_t y0=0;;y0+=TileHeight)
+				{
+					// rows up to the bottom border of the strip; older rows in the ring are no longer needed
+					size_t needed=y0+TileHeight+TileBorder;
+
+					while(!ended && loaded<needed)
+					{
+						size_t slot=loaded%ring_rows;
+						size_t count=needed-loaded<ring_rows-slot ? needed-loaded : ring_rows-slot;
+						size_t received=read(ring.data()+slot*width, count);
+
+						loaded+=received<count ? received : count;
+						ended=received<count;
+					}
+
+					if(y0>=loaded)
+					{
+						break;
+					}
+
+					// until the end is reached the mirrored bottom border is never needed
+					long height=ended ? (long)loaded : std::numeric_limits<long>::max();
+					size_t strip_height=loaded-y0<TileHeight ? loaded-y0 : TileHeight;
+					RingRows rows{ring.data(), width, ring_rows};
+
+					ParallelFor(tiles, threads, [&](size_t begin, size_t end, unsigned int index)
+					{
+						for(size_t tile=begin;tile<end;tile++)
+						{
+							ProcessTile(rows, height, strip.data(), y0, width, (unsigned int)(tile*TileWidth), (long)y0, parameters, buffers[index]);
+						}
+					});
+
+					write(strip.data(), y0, strip_height);
+				}
+
+				return loaded>0 ? STATUS_OK : STATUS_FAIL;
+			}
+
+			// Builds the tone table of the current curve settings once for the following conversions (e.g. a batch
+			// of frames) instead of per call. The curve settings must not change until ReleaseTone
+			int CacheTone()
+			{
+				CachedTone.reset();
+
+				if(settings.use_gammacurve && settings.use_gammacurve_user && gamma_curve_user.getPointsCount()<2)
+				{
+					return STATUS_FAIL;
+				}
+
+				if(settings.use_gammacurve)
+				{
+					CachedTone=BuildToneTable();
+				}
+
+				return STATUS_OK;
+			}
+
+			void ReleaseTone()
+			{
+				CachedTone.reset();
+			}
+
         private:
 
+		// Tile of output pixels: mosaic with border, colour planes and demosaic scratch take ~350 KB
+		static constexpr unsigned int TileWidth=512;
+		static constexpr unsigned int TileHeight=32;
+		static constexpr unsigned int TileBorder=DemosaicBorder;
+
+		// Tone table: for 8-bit output final codes read at the nearest entry, 16 entries per output code (4 KB);
+		// for wider integer and float output values scaled to OutputMaximum, interpolated linearly between
+		// 8192 steps (32 KB) and then rounded - a nearest 16-bit table would be several codes off where the
+		// curve is steep (slope 12.92 of sRGB near black)
+		static constexpr bool ToneNearest=std::is_integral<TypeOutputData>::value && std::numeric_limits<TypeOutputData>::digits<=8;
+		static constexpr unsigned int ToneTableBits=ToneNearest ? std::numeric_limits<TypeOutputData>::digits+4 : 13;
+		static constexpr unsigned int ToneTableSize=1u<<ToneTableBits;
+
+		// White balance statistics: every WhiteBalanceStep-th quad in both directions (1/16 of the pixels),
+		// at least WhiteBalanceMinQuads quads, histograms of [0, 1], normalized values from WhiteBalanceClip are clipped
+		static constexpr size_t WhiteBalanceStep=4;
+		static constexpr size_t WhiteBalanceMinQuads=16384;
+		static constexpr unsigned int WhiteBalanceBins=1024;
+		static constexpr float WhiteBalanceClip=0.98f;
+
+		// ToneTableSize+1 entries of [0, 1] in steps of 1/ToneTableSize: output codes with ToneNearest,
+		// otherwise values scaled to OutputMaximum in Linear, followed by a copy of the last one
+		struct ToneTable
+		{
+			std::vector<TypeOutputData>	Nearest;
+			std::vector<float>		Linear;
+		};
+
+		struct PipelineParameters
+		{
+			RawColorTransform	Transform;
+			bool			UseTone;
+			std::shared_ptr<const ToneTable>	Tone;		// shared with CachedTone when it is set
+			float			OutputMaximum;
+		};
+
+		struct TileBuffers
+		{
+			std::vector<float>	Mosaic;
+			std::vector<float>	Planes;		// red, green and blue planes of TileWidth x TileHeight
+			std::vector<float>	Scratch;
+			std::vector<TypeInputData>	Row;		// unpacked input row
+
+			TileBuffers() : Mosaic((TileWidth+2*TileBorder)*(TileHeight+2*TileBorder)), Planes(3*TileWidth*TileHeight),
+				Scratch(GetDemosaicScratchSize(TileWidth, TileHeight))
+			{
+			}
+		};
+
+		// Black levels, white level, white balance and colour matrix; fold_matrix allows moving
+		// the per-channel part after demosaic, otherwise the matrix is the identity
+		// gains - R, G, B white balance instead of white_balance_coeff
+		// binned - colours are channel averages of normalized values (preview): the levels were applied while
+		// binning, and white balance always commutes with averaging, so all of it moves into Matrix
+		int PrepareTransform(MinMaxValues<TypeInputData> MinMax, bool fold_matrix, PipelineParameters& parameters,
+			unsigned int input_bits=0, const float* white_balance=nullptr, bool binned=false)
+		{
+			if(input_bits>(unsigned int)std::numeric_limits<TypeInputData>::digits)
+			{
+				return STATUS_FAIL;
+			}
+
+			float black[4];
+			float maximum=input_bits>0 ? (float)(((uint64_t)1<<input_bits)-1) : (float)InputDataMaximum;
+			float white=binned ? 1.0f : (settings.normalize_input_data ? (float)MinMax.Max : maximum);
+			float gains[3]={1.0f, 1.0f, 1.0f};
+			float matrix[3][3]={{1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}};
+
+			for(unsigned int c=0;c<4;c++)
+			{
+				black[c]=binned ? 0.0f : (settings.normalize_input_data ? (float)MinMax.Min : (float)black_level[c]);
+			}
+
+			if(settings.use_white_balance)
+			{
+				for(unsigned int c=0;c<3;c++)
+				{
+					gains[c]=white_balance!=nullptr ? white_balance[c] : white_balance_coeff(c, 0);
+				}
+			}
+
+			if(fold_matrix && settings.use_colormatrix)
+			{
+				for(unsigned int i=0;i<3;i++)
+				{
+					for(unsigned int j=0;j<3;j++)
+					{
+						matrix[i][j]=color_matrix(i, j);
+					}
+				}
+			}
+
+			return BuildRawColorTransform(black, white, gains, matrix, fold_matrix && (binned || settings.demosaic_mode==DemosaicBilinear),
+				parameters.Transform);
+		}
+
+		// input_bits - significant bits of packed input, 0 - InputDataMaximum is the white level
+		int PreparePipeline(MinMaxValues<TypeInputData> MinMax, PipelineParameters& parameters, unsigned int input_bits=0,
+			const float* white_balance=nullptr, bool binned=false)
+		{
+			if(PrepareTransform(MinMax, true, parameters, input_bits, white_balance, binned)!=STATUS_OK ||
+				(settings.use_gammacurve && settings.use_gammacurve_user && gamma_curve_user.getPointsCount()<2))
+			{
+				return STATUS_FAIL;
+			}
+
+			parameters.OutputMaximum=std::is_integral<TypeOutputData>::value ? (float)std::numeric_limits<TypeOutputData>::max() : 1.0f;
+			parameters.UseTone=settings.use_gammacurve;
+
+			if(parameters.UseTone)
+			{
+				parameters.Tone=CachedTone ? CachedTone : BuildToneTable();
+			}
+
+			return STATUS_OK;
+		}
+
+		// The curve, clamping and scaling (and for 8-bit output the conversion) in one table
+		std::shared_ptr<const ToneTable> BuildToneTable()
+		{
+			float output_maximum=std::is_integral<TypeOutputData>::value ? (float)std::numeric_limits<TypeOutputData>::max() : 1.0f;
+			std::vector<float> values(ToneTableSize+1);
+
+			if(settings.use_gammacurve_user)
+			{
+				CubicEvaluator<float> curve=gamma_curve_user.compile(ExtrapolateClamp);
+
+				for(unsigned int i=0;i<=ToneTableSize;i++)
+				{
+					values[i]=Saturate(curve((float)i/ToneTableSize))*output_maximum;
+				}
+			}
+			else
+			{
+				for(unsigned int i=0;i<=ToneTableSize;i++)
+				{
+					values[i]=Saturate((float)GetToneCurveValue(settings.tone_curve, (double)i/ToneTableSize))*output_maximum;
+				}
+			}
+
+			std::shared_ptr<ToneTable> table=std::make_shared<ToneTable>();
+
+			if(ToneNearest)
+			{
+				table->Nearest.resize(ToneTableSize+1);
+
+				for(unsigned int i=0;i<=ToneTableSize;i++)
+				{
+					table->Nearest[i]=ConvertOutput(values[i]);
+				}
+			}
+			else
+			{
+				values.push_back(values.back());
+				table->Linear.swap(values);
+			}
+
+			return table;
+		}
+
+		// Gains of the frame: estimated with a white_balance_mode other than WhiteBalanceNone, otherwise (and with
+		// use_white_balance_user, and when unused) white_balance_coeff.
+		// A frame without usable quads keeps unit gains
+		template <typename RowSource>
+		int PrepareGains(const RowSource& rows, MinMaxValues<TypeInputData> MinMax, unsigned int height, unsigned int width,
+			unsigned int input_bits, float gains[3], unsigned int threads)
+		{
+			for(unsigned int c=0;c<3;c++)
+			{
+				gains[c]=white_balance_coeff(c, 0);
+			}
+
+			if(!EstimatesGains())
+			{
+				return STATUS_OK;
+			}
+
+			if(EstimateGains(rows, MinMax, height, width, input_bits, gains, threads)!=STATUS_OK)
+			{
+				gains[0]=gains[1]=gains[2]=1.0f;
+			}
+
+			return STATUS_OK;
+		}
+
+		bool EstimatesGains() const
+		{
+			return settings.use_white_balance && !settings.use_white_balance_user && settings.white_balance_mode!=WhiteBalanceNone;
+		}
+
+		// Sums, maxima and histograms of normalized R, G, B of the samples collected by one thread
+		struct WhiteBalanceStatistics
+		{
+			double					Sum[3];
+			float					Max[3];
+			uint64_t				Count;
+			std::vector<uint64_t>	Histogram[3];
+
+			void Reset()
+			{
+				Count=0;
+
+				for(unsigned int c=0;c<3;c++)
+				{
+					Sum[c]=0.0;
+					Max[c]=0.0f;
+					Histogram[c].assign(WhiteBalanceBins, 0);
+				}
+			}
+
+			void Add(const float rgb[3])
+			{
+				for(unsigned int c=0;c<3;c++)
+				{
+					float v=rgb[c]>0.0f ? rgb[c] : 0.0f;
+					unsigned int bin=(unsigned int)(v*(float)WhiteBalanceBins);
+
+					Sum[c]+=v;
+					Max[c]=v>Max[c] ? v : Max[c];
+					Histogram[c][bin<WhiteBalanceBins ? bin : WhiteBalanceBins-1]++;
+				}
+
+				Count++;
+			}
+
+			void Merge(const WhiteBalanceStatistics& other)
+			{
+				for(unsigned int c=0;c<3;c++)
+				{
+					Sum[c]+=other.Sum[c];
+					Max[c]=other.Max[c]>Max[c] ? other.Max[c] : Max[c];
+
+					for(unsigned int b=0;b<WhiteBalanceBins;b++)
+					{
+						Histogram[c][b]+=other.Histogram[c][b];
+					}
+				}
+
+				Count+=other.Count;
+			}
+		};
+
+		template <typename RowSource>
+		int EstimateGains(const RowSource& rows, MinMaxValues<TypeInputData> MinMax, unsigned int height, unsigned int width,
+			unsigned int input_bits, float gains[3], unsigned int threads)
+		{
+			// black and white levels without white balance
+			PipelineParameters parameters;
+			const float unit[3]={1.0f, 1.0f, 1.0f};
+
+			if(PrepareTransform(MinMax, false, parameters, input_bits, unit)!=STATUS_OK)
+			{
+				return STATUS_FAIL;
+			}
+
+			size_t quads_x=width/2;
+			size_t quads_y=height/2;
+			size_t step=GetWhiteBalanceStep(quads_x, quads_y);
+			size_t rows_count=(quads_y+step-1)/step;
+
+			if(rows_count==0 || quads_x==0)
+			{
+				return STATUS_FAIL;
+			}
+
+			// threads split sampled rows, each gets at least 2^14 quads
+			size_t row_quads=(quads_x+step-1)/step;
+			threads=GetThreadsCount(rows_count, threads, ((size_t)(1 << 14)+row_quads-1)/row_quads);
+			std::vector<WhiteBalanceStatistics> partial(threads);
+
+			for(auto& local : partial)
+			{
+				local.Reset();
+			}
+
+			const RawColorTransform& transform=parameters.Transform;
+
+			// channels of the quad positions (0,0), (1,0), (0,1), (1,1); quads start at even coordinates
+			unsigned int site[4];
+
+			for(unsigned int i=0;i<4;i++)
+			{
+				site[i]=GetBayerChannel(settings.bayer_pattern, i & 1, i >> 1);
+			}
+
+			ParallelFor(rows_count, threads, [&](size_t begin, size_t end, unsigned int index)
+			{
+				WhiteBalanceStatistics& local=partial[index];
+				std::vector<TypeInputData> scratch(2*(size_t)width);
+
+				for(size_t r=begin;r<end;r++)
+				{
+					long y=(long)(r*step*2);
+					const TypeInputData* row[2]={rows(y, 0, width, scratch.data()), rows(y+1, 0, width, scratch.data()+width)};
+
+					for(size_t q=0;q<quads_x;q+=step)
+					{
+						float value[4];
+
+						for(unsigned int i=0;i<4;i++)
+						{
+							unsigned int c=site[i];
+							value[c]=(float)row[i >> 1][2*q+(i & 1)]*transform.InputGain[c]+transform.InputOffset[c];
+						}
+
+						if(value[ChannelR]>=WhiteBalanceClip || value[ChannelG1]>=WhiteBalanceClip ||
+							value[ChannelG2]>=WhiteBalanceClip || value[ChannelB]>=WhiteBalanceClip)
+						{
+							continue;
+						}
+
+						float rgb[3]={value[ChannelR], (value[ChannelG1]+value[ChannelG2])*0.5f, value[ChannelB]};
+
+						local.Add(rgb);
+					}
+				}
+			});
+
+			return GetGains(partial, gains);
+		}
+
+		// Sampling step of white balance statistics, small frames are sampled more densely
+		static size_t GetWhiteBalanceStep(size_t columns, size_t rows)
+		{
+			size_t step=WhiteBalanceStep;
+
+			while(step>1 && (columns/step)*(rows/step)<WhiteBalanceMinQuads)
+			{
+				step/=2;
+			}
+
+			return step;
+		}
+
+		// Gains by settings.white_balance_mode from the merged statistics of the threads
+		int GetGains(std::vector<WhiteBalanceStatistics>& partial, float gains[3])
+		{
+			WhiteBalanceStatistics& statistics=partial[0];
+
+			for(size_t i=1;i<partial.size();i++)
+			{
+				statistics.Merge(partial[i]);
+			}
+
+			uint64_t count=statistics.Count;
+
+			if(count==0)
+			{
+				return STATUS_FAIL;
+			}
+
+			// reference level of every channel
+			double level[3];
+			double percentile=(white_balance_target>0 && white_balance_target<100 ? white_balance_target : 99)/100.0;
+
+			for(unsigned int c=0;c<3;c++)
+			{
+				if(settings.white_balance_mode==WhiteBalanceWhitePatch)
+				{
+					level[c]=statistics.Max[c];
+				}
+				else if(settings.white_balance_mode==WhiteBalancePercentile)
+				{
+					// upper edge of the bin that reaches the percentile
+					uint64_t target=(uint64_t)std::ceil(percentile*(double)count);
+					uint64_t accumulated=0;
+					unsigned int b=0;
+
+					for(;b<WhiteBalanceBins-1;b++)
+					{
+						accumulated+=statistics.Histogram[c][b];
+
+						if(accumulated>=target)
+						{
+							break;
+						}
+					}
+
+					level[c]=(double)(b+1)/WhiteBalanceBins;
+				}
+				else
+				{
+					level[c]=statistics.Sum[c]/(double)count;
+				}
+			}
+
+			if(!(level[0]>0.0 && level[1]>0.0 && level[2]>0.0))
+			{
+				return STATUS_FAIL;
+			}
+
+			for(unsigned int c=0;c<3;c++)
+			{
+				gains[c]=(float)(level[1]/level[c]);
+			}
+
+			return STATUS_OK;
+		}
+
+		// Sums of block neighbouring samples of each colour of a Bayer row, for count outputs: the row is split
+		// into its even and odd columns, then both halves are added pairwise until count sums remain. All loops
+		// store with unit stride (gcc vectorizes them, stride-2 stores into accumulators it does not).
+		// buffer holds 4*count*block floats; sums receives the even and odd column sums
+		static void BinBayerRow(const TypeInputData* row, size_t count, size_t block, float* buffer, const float* sums[2])
+		{
+			size_t size=count*block;
+			float* from=buffer;
+			float* to=buffer+2*size;
+
+			{
+				float* __restrict even=from;
+				float* __restrict odd=from+size;
+
+				for(size_t k=0;k<size;k++)
+				{
+					even[k]=(float)row[2*k];
+					odd[k]=(float)row[2*k+1];
+				}
+			}
+
+			for(size_t length=size;length>count;length/=2)
+			{
+				for(size_t p=0;p<2;p++)
+				{
+					const float* __restrict source=from+p*size;
+					float* __restrict destination=to+p*size;
+
+					for(size_t k=0;k<length/2;k++)
+					{
+						destination[k]=source[2*k]+source[2*k+1];
+					}
+				}
+
+				std::swap(from, to);
+			}
+
+			sums[0]=from;
+			sums[1]=from+size;
+		}
+
+		template <typename RowSource>
+		int PreviewFrame(const RowSource& rows, TypeOutputData* output, MinMaxValues<TypeInputData> MinMax,
+			unsigned int height, unsigned int width, unsigned int downscale, unsigned int threads, unsigned int input_bits)
+		{
+			unsigned int output_width=GetPreviewSize(width, downscale);
+			unsigned int output_height=GetPreviewSize(height, downscale);
+
+			if(output==nullptr || output_width==0 || output_height==0)
+			{
+				return STATUS_FAIL;
+			}
+
+			// blocks are binned into normalized camera RGB (black and white levels, unit gains), the binned
+			// transform of PreparePipeline then holds only white balance and colour matrix
+			PipelineParameters normalization;
+			PipelineParameters parameters;
+			const float unit[3]={1.0f, 1.0f, 1.0f};
+			float gains[3];
+
+			for(unsigned int c=0;c<3;c++)
+			{
+				gains[c]=white_balance_coeff(c, 0);
+			}
+
+			if(PrepareTransform(MinMax, false, normalization, input_bits, unit)!=STATUS_OK)
+			{
+				return STATUS_FAIL;
+			}
+
+			// quads per block side, columns used
+			size_t block=(size_t)1<<downscale;
+			size_t used_width=(size_t)output_width*block*2;
+			float scale=1.0f/(float)(block*block);
+
+			// plane, weight and offset of every quad position: the block mean of the normalized channel,
+			// greens share a plane with half weights
+			unsigned int plane_of_site[4];
+			float weight[4];
+			float offset[4];
+
+			for(unsigned int i=0;i<4;i++)
+			{
+				unsigned int c=GetBayerChannel(settings.bayer_pattern, i & 1, i >> 1);
+				float share=c==ChannelG1 || c==ChannelG2 ? 0.5f : 1.0f;
+
+				plane_of_site[i]=c==ChannelR ? 0 : (c==ChannelB ? 2 : 1);
+				weight[i]=scale*normalization.Transform.InputGain[c]*share;
+				offset[i]=normalization.Transform.InputOffset[c]*share;
+			}
+
+			threads=GetThreadsCount((size_t)output_height*used_width*block*2, threads, 1 << 18);
+
+			// white balance from binned pixels sampled as the quads of EstimateGains (counted in quads of the
+			// blocks): only the sampled blocks are binned here, 1/16 of them in large frames, with the weights used below
+			if(EstimatesGains())
+			{
+				size_t step=GetWhiteBalanceStep((size_t)output_width*block, (size_t)output_height*block);
+				size_t rows_count=(output_height+step-1)/step;
+				size_t samples=(output_width+step-1)/step;
+				unsigned int sample_threads=GetThreadsCount(rows_count, threads, 1);
+				std::vector<WhiteBalanceStatistics> partial(sample_threads);
+
+				for(auto& local : partial)
+				{
+					local.Reset();
+				}
+
+				ParallelFor(rows_count, sample_threads, [&](size_t begin, size_t end, unsigned int index)
+				{
+					std::vector<float> site_sums(4*samples);
+					std::vector<TypeInputData> scratch(2*(size_t)width);
+
+					for(size_t k=begin;k<end;k++)
+					{
+						std::fill(site_sums.begin(), site_sums.end(), 0.0f);
+
+						for(size_t q=0;q<block;q++)
+						{
+							long y=(long)((k*step*block+q)*2);
+							const TypeInputData* row[2]={rows(y, 0, (long)used_width, scratch.data()),
+								rows(y+1, 0, (long)used_width, scratch.data()+width)};
+
+							for(size_t s=0;s<samples;s++)
+							{
+								size_t x=s*step*block*2;
+
+								for(size_t j=0;j<block;j++)
+								{
+									for(unsigned int i=0;i<4;i++)
+									{
+										site_sums[s*4+i]+=(float)row[i >> 1][x+2*j+(i & 1)];
+									}
+								}
+							}
+						}
+
+						for(size_t s=0;s<samples;s++)
+						{
+							float rgb[3]={0.0f, 0.0f, 0.0f};
+
+							for(unsigned int i=0;i<4;i++)
+							{
+								rgb[plane_of_site[i]]+=site_sums[s*4+i]*weight[i]+offset[i];
+							}
+
+							// blocks with a clipped channel mean are skipped
+							if(rgb[0]<WhiteBalanceClip && rgb[1]<WhiteBalanceClip && rgb[2]<WhiteBalanceClip)
+							{
+								partial[index].Add(rgb);
+							}
+						}
+					}
+				});
+
+				if(GetGains(partial, gains)!=STATUS_OK)
+				{
+					gains[0]=gains[1]=gains[2]=1.0f;
+				}
+			}
+
+			if(PreparePipeline(MinMax, parameters, input_bits, gains, true)!=STATUS_OK)
+			{
+				return STATUS_FAIL;
+			}
+
+			ParallelFor(output_height, threads, [&](size_t begin, size_t end, unsigned int)
+			{
+				std::vector<float> sums(3*(size_t)output_width);
+				std::vector<float> buffer(4*(size_t)output_width*block);
+				std::vector<TypeInputData> scratch(2*(size_t)width);
+				float* planes[3]={sums.data(), sums.data()+output_width, sums.data()+2*(size_t)output_width};
+
+				for(size_t r=begin;r<end;r++)
+				{
+					std::fill(sums.begin(), sums.end(), 0.0f);
+
+					for(size_t q=0;q<block;q++)
+					{
+						long y=(long)((r*block+q)*2);
+						const TypeInputData* row[2]={rows(y, 0, (long)used_width, scratch.data()),
+							rows(y+1, 0, (long)used_width, scratch.data()+width)};
+
+						for(unsigned int parity=0;parity<2;parity++)
+						{
+							const float* column[2];
+
+							BinBayerRow(row[parity], output_width, block, buffer.data(), column);
+
+							for(unsigned int i=parity*2;i<parity*2+2;i++)
+							{
+								const float* __restrict value=column[i & 1];
+								float* __restrict sum=planes[plane_of_site[i]];
+								float site_weight=weight[i];
+								float site_offset=offset[i]/(float)block;
+
+								for(size_t o=0;o<output_width;o++)
+								{
+									sum[o]+=value[o]*site_weight+site_offset;
+								}
+							}
+						}
+					}
+
+					WriteRow(planes, output_width, parameters, output+r*output_width*3);
+				}
+			});
+
+			return STATUS_OK;
+		}
+
+		// Tiles of the frame are taken by threads from a shared counter
+		template <typename RowSource>
+		void ProcessFrame(const RowSource& rows, TypeOutputData* output, unsigned int height, unsigned int width,
+			const PipelineParameters& parameters, unsigned int threads)
+		{
+			size_t tiles_x=(width+TileWidth-1)/TileWidth;
+			size_t tiles_y=(height+TileHeight-1)/TileHeight;
+			size_t tiles=tiles_x*tiles_y;
+
+			std::atomic<size_t> next_tile(0);
+			threads=GetThreadsCount(tiles, threads, 1);
+
+			ParallelFor(threads, threads, [&](size_t, size_t, unsigned int)
+			{
+				TileBuffers buffers;
+
+				for(size_t tile=next_tile++;tile<tiles;tile=next_tile++)
+				{
+					unsigned int x0=(unsigned int)(tile%tiles_x)*TileWidth;
+					unsigned int y0=(unsigned int)(tile/tiles_x)*TileHeight;
+
+					ProcessTile(rows, height, output, 0, width, x0, y0, parameters, buffers);
+				}
+			});
+		}
+
+		// Row sources for LoadTile: return row y where pixels [begin, end) are valid at their column index;
+		// scratch is a row of the thread that a source may fill
+		struct FrameRows
+		{
+			const TypeInputData*	Input;
+			unsigned int			Width;
+
+			const TypeInputData* operator()(long y, long, long, TypeInputData*) const
+			{
+				return Input+(size_t)y*Width;
+			}
+		};
+
+		struct RingRows
+		{
+			const TypeInputData*	Ring;
+			unsigned int			Width;
+			size_t					Rows;
+
+			const TypeInputData* operator()(long y, long, long, TypeInputData*) const
+			{
+				return Ring+((size_t)y%Rows)*Width;
+			}
+		};
+
+		// Packed sensor rows are unpacked only for the columns of the tile, straight before conversion to float
+		struct PackedRows
+		{
+			const uint8_t*			Data;
+			size_t					RowStride;
+			unsigned int			Format;
+
+			const TypeInputData* operator()(long y, long begin, long end, TypeInputData* scratch) const
+			{
+				UnpackRow(Format, Data+(size_t)y*RowStride, (size_t)begin, (size_t)(end-begin), scratch);
+				return scratch;
+			}
+		};
+
+		// Loads tile_width x tile_height pixels at (x0, y0) with TileBorder pixels of border through the
+		// colour transform; the border is mirrored at the frame edges
+		template <typename RowSource>
+		void LoadTile(const RowSource& rows, long height, unsigned int width, unsigned int x0, long y0,
+			unsigned int tile_width, unsigned int tile_height, const PipelineParameters& parameters, float* mosaic,
+			TypeInputData* row_scratch)
+		{
+			long stride=tile_width+2*TileBorder;
+
+			for(long r=0;r<(long)(tile_height+2*TileBorder);r++)
+			{
+				long y=MirrorCoordinate(y0+r-(long)TileBorder, height);
+				float* destination=mosaic+r*stride;
+
+				long x_begin=(long)x0-(long)TileBorder;
+				long x_end=(long)(x0+tile_width+TileBorder);
+				long inner_begin=x_begin<0 ? 0 : x_begin;
+				long inner_end=x_end>(long)width ? (long)width : x_end;
+
+				// mirrored border columns fall inside [inner_begin, inner_end)
+				const TypeInputData* source=rows(y, inner_begin, inner_end, row_scratch);
+
+				const RawColorTransform& transform=parameters.Transform;
+				unsigned int c0=GetBayerChannel(settings.bayer_pattern, 0, (unsigned int)y);
+				unsigned int c1=GetBayerChannel(settings.bayer_pattern, 1, (unsigned int)y);
+				float gain[2]={transform.InputGain[c0], transform.InputGain[c1]};
+				float offset[2]={transform.InputOffset[c0], transform.InputOffset[c1]};
+
+				// pairs of columns starting at an even column, one multiply-add per pixel
+				long x=inner_begin;
+				float* pair_destination=destination+(x-x_begin);
+
+				if(x&1)
+				{
+					*pair_destination++=(float)source[x]*gain[1]+offset[1];
+					x++;
+				}
+
+				const TypeInputData* pair_source=source+x;
+				long pairs=(inner_end-x)/2;
+
+				for(long i=0;i<pairs;i++)
+				{
+					pair_destination[2*i]=(float)pair_source[2*i]*gain[0]+offset[0];
+					pair_destination[2*i+1]=(float)pair_source[2*i+1]*gain[1]+offset[1];
+				}
+
+				if(x+2*pairs<inner_end)
+				{
+					pair_destination[2*pairs]=(float)pair_source[2*pairs]*gain[0]+offset[0];
+				}
+
+				for(x=x_begin<inner_begin ? x_begin : inner_end;x<x_end;x=(x+1==inner_begin ? inner_end : x+1))
+				{
+					long mirrored=MirrorCoordinate(x, width);
+					destination[x-x_begin]=(float)source[mirrored]*gain[mirrored&1]+offset[mirrored&1];
+				}
+			}
+		}
+
+		// output holds rows from output_first_row on
+		template <typename RowSource>
+		void ProcessTile(const RowSource& rows, long height, TypeOutputData* output, size_t output_first_row, unsigned int width,
+			unsigned int x0, long y0, const PipelineParameters& parameters, TileBuffers& buffers)
+		{
+			unsigned int tile_width=width-x0<TileWidth ? width-x0 : TileWidth;
+			unsigned int tile_height=height-y0<(long)TileHeight ? (unsigned int)(height-y0) : TileHeight;
+			long stride=tile_width+2*TileBorder;
+			float* mosaic=buffers.Mosaic.data();
+			float* rgb=buffers.Planes.data();
+
+			buffers.Row.resize(width);
+
+			LoadTile(rows, height, width, x0, y0, tile_width, tile_height, parameters, mosaic, buffers.Row.data());
+
+			// tile origin is even, so the tile has the pattern of the frame
+			DemosaicTile(settings.demosaic_mode, mosaic+TileBorder*stride+TileBorder, stride, tile_width, tile_height,
+				settings.bayer_pattern, rgb, rgb+TileWidth*TileHeight, rgb+2*TileWidth*TileHeight, TileWidth, buffers.Scratch.data());
+
+			for(unsigned int r=0;r<tile_height;r++)
+			{
+				float* planes[3]={rgb+r*TileWidth, rgb+(TileHeight+r)*TileWidth, rgb+(2*TileHeight+r)*TileWidth};
+
+				WriteRow(planes, tile_width, parameters, output+(((size_t)y0+r-output_first_row)*width+x0)*3);
+			}
+		}
+
+		// Colour transform after demosaic and tone curve (or plain conversion) of count pixels in planes,
+		// written interleaved to destination; planes are overwritten
+		static void WriteRow(float* const planes[3], unsigned int count, const PipelineParameters& parameters,
+			TypeOutputData* destination)
+		{
+			const RawColorTransform& transform=parameters.Transform;
+			const float (*matrix)[3]=transform.Matrix;
+			const float* bias=transform.Bias;
+
+			if(transform.UseMatrix)
+			{
+				for(unsigned int i=0;i<count;i++)
+				{
+					float red=planes[0][i];
+					float green=planes[1][i];
+					float blue=planes[2][i];
+
+					planes[0][i]=matrix[0][0]*red+matrix[0][1]*green+matrix[0][2]*blue+bias[0];
+					planes[1][i]=matrix[1][0]*red+matrix[1][1]*green+matrix[1][2]*blue+bias[1];
+					planes[2][i]=matrix[2][0]*red+matrix[2][1]*green+matrix[2][2]*blue+bias[2];
+				}
+			}
+
+			if(parameters.UseTone && ToneNearest)
+			{
+				ApplyTone(planes, count, parameters.Tone->Nearest.data(), destination);
+				return;
+			}
+
+			if(parameters.UseTone)
+			{
+				ApplyToneLinear(planes, count, parameters.Tone->Linear.data(), destination);
+				return;
+			}
+
+			float output_maximum=parameters.OutputMaximum;
+
+			for(unsigned int i=0;i<count;i++)
+			{
+				destination[i*3+0]=ConvertOutput(Clamp(planes[0][i]*output_maximum, output_maximum));
+				destination[i*3+1]=ConvertOutput(Clamp(planes[1][i]*output_maximum, output_maximum));
+				destination[i*3+2]=ConvertOutput(Clamp(planes[2][i]*output_maximum, output_maximum));
+			}
+		}
+
+		// value limited to [0, maximum], NaN gives 0
+		static float Clamp(float value, float maximum)
+		{
+			return std::min(maximum, std::max(0.0f, value));
+		}
+
+		static float Saturate(float value)
+		{
+			return Clamp(value, 1.0f);
+		}
+
+		// Interleaved output of a row of planes through the nearest entries of the tone table (8-bit output):
+		// the index is computed for a block of pixels in a loop without lookups, then the table is read with
+		// scalar loads (AVX2 has no 8/16-bit gathers). The index is clamped after scaling and converted
+		// through int32_t: gcc keeps the loop scalar when the clamped value is scaled afterwards (the scaling is
+		// duplicated into branches for the constant ends) and for float to uint32_t conversions
+		static void ApplyTone(float* const planes[3], unsigned int count, const TypeOutputData* tone, TypeOutputData* destination)
+		{
+			const unsigned int Block=256;
+			uint32_t index[3][Block];
+
+			for(unsigned int first=0;first<count;first+=Block)
+			{
+				unsigned int size=count-first<Block ? count-first : Block;
+
+				for(unsigned int c=0;c<3;c++)
+				{
+					const float* plane=planes[c]+first;
+
+					for(unsigned int i=0;i<size;i++)
+					{
+						index[c][i]=(int32_t)Clamp(plane[i]*(float)ToneTableSize+0.5f, (float)ToneTableSize+0.5f);
+					}
+				}
+
+				TypeOutputData* pixel=destination+(size_t)first*3;
+
+				for(unsigned int i=0;i<size;i++)
+				{
+					pixel[i*3+0]=tone[index[0][i]];
+					pixel[i*3+1]=tone[index[1][i]];
+					pixel[i*3+2]=tone[index[2][i]];
+				}
+			}
+		}
+
+		// ApplyTone with linear interpolation between the entries of a float table scaled to the output range.
+		// The padding entry after the end lets the index reach ToneTableSize without another clamp. Position and
+		// fraction are separate loops: with the clamped position used twice gcc branches on the ends again
+		static void ApplyToneLinear(float* const planes[3], unsigned int count, const float* tone, TypeOutputData* destination)
+		{
+			const unsigned int Block=256;
+			int32_t index[3][Block];
+			float fraction[3][Block];
+
+			for(unsigned int first=0;first<count;first+=Block)
+			{
+				unsigned int size=count-first<Block ? count-first : Block;
+
+				for(unsigned int c=0;c<3;c++)
+				{
+					const float* plane=planes[c]+first;
+
+					for(unsigned int i=0;i<size;i++)
+					{
+						fraction[c][i]=Clamp(plane[i]*(float)ToneTableSize, (float)ToneTableSize);
+					}
+
+					for(unsigned int i=0;i<size;i++)
+					{
+						index[c][i]=(int32_t)fraction[c][i];
+						fraction[c][i]-=(float)index[c][i];
+					}
+				}
+
+				TypeOutputData* pixel=destination+(size_t)first*3;
+
+				for(unsigned int i=0;i<size;i++)
+				{
+					for(unsigned int c=0;c<3;c++)
+					{
+						const float* entry=tone+index[c][i];
+
+						pixel[i*3+c]=ConvertOutput(entry[0]+fraction[c][i]*(entry[1]-entry[0]));
+					}
+				}
+			}
+		}
+
+		static TypeOutputData ConvertOutput(float value)
+		{
+			return std::is_integral<TypeOutputData>::value ? (TypeOutputData)(value+0.5f) : (TypeOutputData)value;
+		}
+
 		TypeInputData		InputDataMaximum;
+		std::shared_ptr<const ToneTable>	CachedTone;		// CacheTone, read by concurrent conversions
     };
 
 
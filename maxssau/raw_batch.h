@@ -0,0 +1,290 @@
+#ifndef __raw_batch__
+#define __raw_batch__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "enums.h"
+#include "raw.h"
+#include "raw_file.h"
+
+namespace maxssau
+{
+	// Queue with a fixed capacity between two pipeline stages: Push waits while the queue is full,
+	// Pop waits while it is empty. After Close, Push fails and Pop returns the remaining items, then fails
+	template <typename Type> class BoundedQueue
+	{
+		public:
+			explicit BoundedQueue(size_t capacity) : Capacity(capacity==0 ? 1 : capacity), Closed(false)
+			{
+			}
+
+			bool Push(Type item)
+			{
+				std::unique_lock<std::mutex> lock(Mutex);
+				NotFull.wait(lock, [this]{ return Closed || Items.size()<Capacity; });
+
+				if(Closed)
+				{
+					return false;
+				}
+
+				Items.push_back(std::move(item));
+				NotEmpty.notify_one();
+
+				return true;
+			}
+
+			bool Pop(Type& item)
+			{
+				std::unique_lock<std::mutex> lock(Mutex);
+				NotEmpty.wait(lock, [this]{ return Closed || !Items.empty(); });
+
+				if(Items.empty())
+				{
+					return false;
+				}
+
+				item=std::move(Items.front());
+				Items.pop_front();
+				NotFull.notify_one();
+
+				return true;
+			}
+
+			void Close()
+			{
+				std::lock_guard<std::mutex> lock(Mutex);
+
+				Closed=true;
+				NotEmpty.notify_all();
+				NotFull.notify_all();
+			}
+
+		private:
+			size_t						Capacity;
+			bool						Closed;
+			std::deque<Type>			Items;
+			std::mutex					Mutex;
+			std::condition_variable		NotEmpty;
+			std::condition_variable		NotFull;
+	};
+
+	// Frame passed between the stages of raw_batch_converter
+	template <typename TypeInputData, typename TypeOutputData> struct RawBatchFrame
+	{
+		size_t								Index;			// position in the list of paths
+		std::string							Path;
+		int									Status;			// STATUS_FAIL once any stage failed
+		RawFile								File;			// closed after unpack
+		unsigned int						Width;			// layout of the file, kept after it is closed
+		unsigned int						Height;
+		unsigned int						Bits;			// significant bits of the packed samples
+		std::vector<TypeInputData>			Plane;			// unpacked mosaic, height x width
+		BayerStatistics<TypeInputData>		Statistics;
+		std::vector<TypeOutputData>			Image;			// converted RGB, height x width x 3
+	};
+
+	typedef struct raw_batch_settings
+	{
+		unsigned int read_threads;			// open and read files (I/O bound)
+		unsigned int unpack_threads;		// unpack and per-channel min/max
+		unsigned int convert_threads;		// frames converted at the same time
+		unsigned int encode_threads;		// output callbacks
+		unsigned int frame_threads;			// threads of raw_converter::Process inside one frame
+		size_t queue_depth;					// frames waiting between two stages
+	} raw_batch_settings;
+
+	// Conversion of many raw files with the frames pipelined: read -> unpack -> convert -> encode run on
+	// their own threads and are connected by bounded queues, so while one frame is converted the next ones
+	// are read and unpacked and the previous ones encoded. Throughput is limited by the slowest stage,
+	// memory by the number of frames in flight (stage threads plus queue_depth per queue).
+	// Frames reach encode in completion order; RawBatchFrame::Index gives the original position.
+	template <typename TypeInputData, typename TypeOutputData> class raw_batch_converter
+	{
+		public:
+			typedef RawBatchFrame<TypeInputData, TypeOutputData> Frame;
+			// Sets the layout of the opened file (RawFile::SetLayout), e.g. from its header
+			typedef std::function<int(RawFile& file, size_t index)> LayoutFunction;
+			// Receives every converted frame, runs on the encode threads
+			typedef std::function<int(Frame& frame)> EncodeFunction;
+
+			raw_batch_settings									settings;
+			raw_converter<TypeInputData, TypeOutputData>		converter;		// settings shared by all frames
+
+			raw_batch_converter()
+			{
+				settings.read_threads=2;
+				settings.unpack_threads=1;
+				settings.convert_threads=1;
+				settings.encode_threads=1;
+				settings.frame_threads=0;
+				settings.queue_depth=2;
+			}
+
+			// Converts all paths, returns STATUS_OK when every frame was read, converted and encoded.
+			// With converter.settings.normalize_input_data the range of a frame is its own min/max,
+			// otherwise the white level is the maximum of the packed bit depth
+			int Run(const std::vector<std::string>& paths, LayoutFunction layout, EncodeFunction encode)
+			{
+				if(!layout || !encode)
+				{
+					return STATUS_FAIL;
+				}
+
+				// one tone table for all frames; the convert threads do not touch the user curve
+				if(converter.CacheTone()!=STATUS_OK)
+				{
+					return STATUS_FAIL;
+				}
+
+				typedef std::unique_ptr<Frame> FramePointer;
+
+				BoundedQueue<FramePointer> read_queue(settings.queue_depth);
+				BoundedQueue<FramePointer> unpack_queue(settings.queue_depth);
+				BoundedQueue<FramePointer> convert_queue(settings.queue_depth);
+
+				std::atomic<size_t> next_path(0);
+				std::atomic<size_t> failed(0);
+				std::vector<std::thread> workers;
+
+				// the last worker of a stage closes the queue after it
+				auto stage=[&](unsigned int threads, BoundedQueue<FramePointer>* input, BoundedQueue<FramePointer>* output,
+					std::function<void(Frame&)> work)
+				{
+					threads=threads==0 ? 1 : threads;
+					auto active=std::make_shared<std::atomic<unsigned int>>(threads);
+
+					for(unsigned int t=0;t<threads;t++)
+					{
+						workers.emplace_back([&, input, output, work, active]()
+						{
+							FramePointer frame;
+
+							while(input!=nullptr ? input->Pop(frame) : NextFrame(paths, next_path, frame))
+							{
+								if(frame->Status==STATUS_OK)
+								{
+									work(*frame);
+								}
+
+								if(output!=nullptr)
+								{
+									output->Push(std::move(frame));
+								}
+								else
+								{
+									failed+=frame->Status!=STATUS_OK ? 1 : 0;
+									frame.reset();
+								}
+							}
+
+							if(--(*active)==0 && output!=nullptr)
+							{
+								output->Close();
+							}
+						});
+					}
+				};
+
+				stage(settings.read_threads, nullptr, &read_queue, [&](Frame& frame)
+				{
+					frame.Status=ReadStage(frame, layout);
+				});
+
+				stage(settings.unpack_threads, &read_queue, &unpack_queue, [&](Frame& frame)
+				{
+					frame.Status=UnpackStage(frame);
+				});
+
+				stage(settings.convert_threads, &unpack_queue, &convert_queue, [&](Frame& frame)
+				{
+					frame.Status=ConvertStage(frame);
+				});
+
+				stage(settings.encode_threads, &convert_queue, nullptr, [&](Frame& frame)
+				{
+					frame.Status=encode(frame);
+				});
+
+				for(auto& worker : workers)
+				{
+					worker.join();
+				}
+
+				converter.ReleaseTone();
+
+				return failed==0 ? STATUS_OK : STATUS_FAIL;
+			}
+
+		private:
+
+		static bool NextFrame(const std::vector<std::string>& paths, std::atomic<size_t>& next_path, std::unique_ptr<Frame>& frame)
+		{
+			size_t index=next_path++;
+
+			if(index>=paths.size())
+			{
+				return false;
+			}
+
+			frame.reset(new Frame());
+			frame->Index=index;
+			frame->Path=paths[index];
+			frame->Status=STATUS_OK;
+			frame->Width=0;
+			frame->Height=0;
+			frame->Bits=0;
+
+			return true;
+		}
+
+		int ReadStage(Frame& frame, LayoutFunction& layout)
+		{
+			if(frame.File.Open(frame.Path.c_str())!=STATUS_OK || layout(frame.File, frame.Index)!=STATUS_OK ||
+				!frame.File.HasLayout())
+			{
+				return STATUS_FAIL;
+			}
+
+			frame.File.Prefetch();
+
+			frame.Width=frame.File.GetWidth();
+			frame.Height=frame.File.GetHeight();
+			frame.Bits=GetPackedBits(frame.File.GetFormat());
+
+			return STATUS_OK;
+		}
+
+		int UnpackStage(Frame& frame)
+		{
+			frame.Plane.resize((size_t)frame.Width*frame.Height);
+
+			int status=converter.Unpack(frame.File, frame.Plane.data(), &frame.Statistics, 1);
+			frame.File.Close();
+
+			return status;
+		}
+
+		int ConvertStage(Frame& frame)
+		{
+			frame.Image.resize((size_t)frame.Width*frame.Height*3);
+
+			int status=converter.Process(frame.Plane.data(), frame.Image.data(), frame.Statistics.GetMinMax(), frame.Height,
+				frame.Width, settings.frame_threads, frame.Bits);
+
+			std::vector<TypeInputData>().swap(frame.Plane);
+
+			return status;
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,572 @@
+#ifndef __raw_file__
+#define __raw_file__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <type_traits>
+#include <vector>
+
+#if defined(__AVX2__)
+	#include <immintrin.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+	#define __raw_file_mmap__
+#endif
+
+#include "enums.h"
+#include "parallel.h"
+
+namespace maxssau
+{
+	// Layout of sensor samples in a row
+	enum PackedFormat
+	{
+		Plain16LE=0,	// 16-bit little-endian
+		Plain16BE=1,	// 16-bit big-endian
+		Packed10=2,		// MIPI RAW10: 4 pixels in 5 bytes, high 8 bits then a byte of 2-bit remainders
+		Packed12=3,		// MIPI RAW12: 2 pixels in 3 bytes, high 8 bits then a byte of 4-bit remainders
+		Packed14=4		// MIPI RAW14: 4 pixels in 7 bytes, high 8 bits then 3 bytes of 6-bit remainders
+	};
+
+	inline unsigned int GetPackedBits(unsigned int format)
+	{
+		static const unsigned char bits[5]={16, 16, 10, 12, 14};
+
+		return format<5 ? bits[format] : 0;
+	}
+
+	// Pixels and bytes in one group of the format; unpacking starts at a group boundary
+	inline unsigned int GetPackedGroupPixels(unsigned int format)
+	{
+		return format==Packed12 ? 2 : (format==Packed10 || format==Packed14 ? 4 : 1);
+	}
+
+	inline unsigned int GetPackedGroupBytes(unsigned int format)
+	{
+		static const unsigned char bytes[5]={2, 2, 5, 3, 7};
+
+		return format<5 ? bytes[format] : 0;
+	}
+
+	inline size_t GetPackedRowBytes(unsigned int format, size_t width)
+	{
+		size_t group=GetPackedGroupPixels(format);
+
+		return (width+group-1)/group*GetPackedGroupBytes(format);
+	}
+
+	// Unpacks pixels [first, first+count) of a packed row one group at a time, for partial groups at the ends
+	template <typename Type>
+	void UnpackPartialGroups(unsigned int format, const uint8_t* row, size_t first, size_t count, Type* output)
+	{
+		size_t group_pixels=GetPackedGroupPixels(format);
+		size_t group_bytes=GetPackedGroupBytes(format);
+		size_t begin=first/group_pixels*group_pixels;
+		size_t end=first+count;
+		const uint8_t* source=row+begin/group_pixels*group_bytes;
+
+		for(size_t x=begin;x<end;x+=group_pixels, source+=group_bytes)
+		{
+			unsigned int values[4];
+
+			switch(format)
+			{
+				case Plain16LE:
+					values[0]=source[0] | (source[1]<<8);
+					break;
+
+				case Plain16BE:
+					values[0]=(source[0]<<8) | source[1];
+					break;
+
+				case Packed10:
+					for(unsigned int i=0;i<4;i++)
+					{
+						values[i]=(source[i]<<2) | ((source[4]>>(2*i)) & 3);
+					}
+					break;
+
+				case Packed12:
+					values[0]=(source[0]<<4) | (source[2] & 15);
+					values[1]=(source[1]<<4) | (source[2]>>4);
+					break;
+
+				default:
+				{
+					unsigned int low=source[4] | (source[5]<<8) | (source[6]<<16);
+
+					for(unsigned int i=0;i<4;i++)
+					{
+						values[i]=(source[i]<<6) | ((low>>(6*i)) & 63);
+					}
+					break;
+				}
+			}
+
+			for(size_t i=0;i<group_pixels;i++)
+			{
+				if(x+i>=first && x+i<end)
+				{
+					output[x+i]=(Type)values[i];
+				}
+			}
+		}
+	}
+
+#if defined(__AVX2__)
+	// AVX2 kernel of UnpackGroups for 16-bit output: 16 pixels per step, 8 from every 128-bit lane
+	// (2 groups of Packed10 or Packed14, 4 of Packed12, 8 samples of Plain16). Every pixel is
+	// (high byte << extra bits) | (low bits taken out of a 16-bit word of remainder bytes): one shuffle places the
+	// high bytes, another the remainder words, a per-pixel multiply moves the wanted bits to the top of the word
+	// and a shift brings them down. Returns the number of groups done, the scalar loops unpack the rest.
+	// The second lane reads 16 bytes from its start, so the last few groups are always left to the scalar loops
+	inline size_t UnpackGroupsAVX2(unsigned int format, const uint8_t* source, size_t groups, uint16_t* output)
+	{
+		const char Z=-1;	// zero byte in a shuffle
+
+		// per format: high byte shuffle, remainder word shuffle, multipliers, bits of the remainder
+		static const char high[5][16]=
+		{
+			{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+			{1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14},
+			{Z, 0, Z, 1, Z, 2, Z, 3, Z, 5, Z, 6, Z, 7, Z, 8},
+			{Z, 0, Z, 1, Z, 3, Z, 4, Z, 6, Z, 7, Z, 9, Z, 10},
+			{Z, 0, Z, 1, Z, 2, Z, 3, Z, 7, Z, 8, Z, 9, Z, 10}
+		};
+
+		static const char low[5][16]=
+		{
+			{Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z},
+			{Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z, Z},
+			{4, Z, 4, Z, 4, Z, 4, Z, 9, Z, 9, Z, 9, Z, 9, Z},
+			{2, Z, 2, Z, 5, Z, 5, Z, 8, Z, 8, Z, 11, Z, 11, Z},
+			{4, 5, 4, 5, 5, 6, 5, 6, 11, 12, 11, 12, 12, 13, 12, 13}
+		};
+
+		// remainder bits of pixel k start at bit 2k (Packed10), 4k (Packed12), 0, 6, 12-8, 18-8 (Packed14)
+		static const unsigned short multiplier[5][8]=
+		{
+			{1, 1, 1, 1, 1, 1, 1, 1},
+			{1, 1, 1, 1, 1, 1, 1, 1},
+			{1 << 14, 1 << 12, 1 << 10, 1 << 8, 1 << 14, 1 << 12, 1 << 10, 1 << 8},
+			{1 << 12, 1 << 8, 1 << 12, 1 << 8, 1 << 12, 1 << 8, 1 << 12, 1 << 8},
+			{1 << 10, 1 << 4, 1 << 6, 1 << 0, 1 << 10, 1 << 4, 1 << 6, 1 << 0}
+		};
+
+		if(format>Packed14)
+		{
+			return 0;
+		}
+
+		size_t group_bytes=GetPackedGroupBytes(format);
+		size_t step_groups=16/GetPackedGroupPixels(format);
+		size_t lane_bytes=step_groups/2*group_bytes;
+		int extra=(int)GetPackedBits(format)-8;
+
+		__m256i high_shuffle=_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)high[format]));
+		__m256i low_shuffle=_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)low[format]));
+		__m256i multipliers=_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)multiplier[format]));
+		__m128i high_shift=_mm_cvtsi32_si128(8-extra);
+		__m128i low_shift=_mm_cvtsi32_si128(16-extra);
+
+		size_t steps=groups*group_bytes>=lane_bytes+16 ? (groups*group_bytes-lane_bytes-16)/(2*lane_bytes)+1 : 0;
+
+		for(size_t i=0;i<steps;i++, source+=2*lane_bytes, output+=16)
+		{
+			__m256i bytes=_mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)source)),
+				_mm_loadu_si128((const __m128i*)(source+lane_bytes)), 1);
+
+			__m256i pixels=_mm256_shuffle_epi8(bytes, high_shuffle);
+
+			if(extra<8)
+			{
+				__m256i remainder=_mm256_mullo_epi16(_mm256_shuffle_epi8(bytes, low_shuffle), multipliers);
+
+				pixels=_mm256_or_si256(_mm256_srl_epi16(pixels, high_shift), _mm256_srl_epi16(remainder, low_shift));
+			}
+
+			_mm256_storeu_si256((__m256i*)output, pixels);
+		}
+
+		return steps*step_groups;
+	}
+#endif
+
+	// Unpacks groups whole groups. With AVX2 and 16-bit output most groups go through UnpackGroupsAVX2.
+	// The scalar loops below (one branch-free loop per format with fixed byte offsets in the group) are the
+	// fallback and the tail; gcc 12 vectorizes only the Plain16 and Packed12 ones and only at -O3
+	template <typename Type>
+	void UnpackGroups(unsigned int format, const uint8_t* source, size_t groups, Type* output)
+	{
+#if defined(__AVX2__)
+		if(std::is_same<Type, uint16_t>::value)
+		{
+			size_t done=UnpackGroupsAVX2(format, source, groups, reinterpret_cast<uint16_t*>(output));
+
+			source+=done*GetPackedGroupBytes(format);
+			output+=done*GetPackedGroupPixels(format);
+			groups-=done;
+		}
+#endif
+
+		switch(format)
+		{
+			case Plain16LE:
+				for(size_t i=0;i<groups;i++)
+				{
+					output[i]=(Type)(source[2*i] | (source[2*i+1]<<8));
+				}
+				break;
+
+			case Plain16BE:
+				for(size_t i=0;i<groups;i++)
+				{
+					output[i]=(Type)((source[2*i]<<8) | source[2*i+1]);
+				}
+				break;
+
+			case Packed10:
+				for(size_t i=0;i<groups;i++)
+				{
+					const uint8_t* s=source+5*i;
+					unsigned int low=s[4];
+
+					output[4*i+0]=(Type)((s[0]<<2) | (low & 3));
+					output[4*i+1]=(Type)((s[1]<<2) | ((low>>2) & 3));
+					output[4*i+2]=(Type)((s[2]<<2) | ((low>>4) & 3));
+					output[4*i+3]=(Type)((s[3]<<2) | (low>>6));
+				}
+				break;
+
+			case Packed12:
+				for(size_t i=0;i<groups;i++)
+				{
+					const uint8_t* s=source+3*i;
+
+					output[2*i+0]=(Type)((s[0]<<4) | (s[2] & 15));
+					output[2*i+1]=(Type)((s[1]<<4) | (s[2]>>4));
+				}
+				break;
+
+			case Packed14:
+				for(size_t i=0;i<groups;i++)
+				{
+					const uint8_t* s=source+7*i;
+
+					output[4*i+0]=(Type)((s[0]<<6) | (s[4] & 63));
+					output[4*i+1]=(Type)((s[1]<<6) | (s[4]>>6) | ((s[5] & 15)<<2));
+					output[4*i+2]=(Type)((s[2]<<6) | (s[5]>>4) | ((s[6] & 3)<<4));
+					output[4*i+3]=(Type)((s[3]<<6) | (s[6]>>2));
+				}
+				break;
+		}
+	}
+
+	// Unpacks pixels [first, first+count) of a packed row into output[first..first+count)
+	template <typename Type>
+	void UnpackRow(unsigned int format, const uint8_t* row, size_t first, size_t count, Type* output)
+	{
+		size_t group_pixels=GetPackedGroupPixels(format);
+		size_t group_bytes=GetPackedGroupBytes(format);
+		size_t end=first+count;
+		size_t head=(first+group_pixels-1)/group_pixels;		// first whole group
+		size_t tail=end/group_pixels;							// group after the last whole one
+
+		if(head>=tail)
+		{
+			UnpackPartialGroups(format, row, first, count, output);
+			return;
+		}
+
+		if(first<head*group_pixels)
+		{
+			UnpackPartialGroups(format, row, first, head*group_pixels-first, output);
+		}
+
+		UnpackGroups(format, row+head*group_bytes, tail-head, output+head*group_pixels);
+
+		if(tail*group_pixels<end)
+		{
+			UnpackPartialGroups(format, row, tail*group_pixels, end-tail*group_pixels, output);
+		}
+	}
+
+	// Unpacks a whole frame (height rows of row_stride bytes) into a plane of height x width pixels,
+	// row bands on threads (0 - all hardware threads)
+	template <typename Type>
+	int UnpackFrame(unsigned int format, const uint8_t* data, size_t row_stride, unsigned int height, unsigned int width,
+		Type* output, unsigned int threads=1)
+	{
+		if(data==nullptr || output==nullptr || GetPackedBits(format)==0 || row_stride<GetPackedRowBytes(format, width))
+		{
+			return STATUS_FAIL;
+		}
+
+		threads=GetThreadsCount((size_t)height*width, threads, 1 << 18);
+
+		ParallelFor(height, threads, [&](size_t begin, size_t end, unsigned int)
+		{
+			for(size_t y=begin;y<end;y++)
+			{
+				UnpackRow(format, data+y*row_stride, 0, width, output+y*width);
+			}
+		});
+
+		return STATUS_OK;
+	}
+
+	// Read-only memory mapping of a raw file (or the whole file in memory where mmap is not available)
+	// with the layout of the sensor data in it. Rows are read by the converter directly from the mapping.
+	class RawFile
+	{
+	public:
+		RawFile()
+		{
+			Data=nullptr;
+			Size=0;
+			Mapped=false;
+			ResetLayout();
+		}
+
+		~RawFile()
+		{
+			Close();
+		}
+
+		RawFile(const RawFile&)=delete;
+		RawFile& operator=(const RawFile&)=delete;
+
+		// The layout is reset, SetLayout is called for the opened file
+		int Open(const char* path)
+		{
+			Close();
+
+#ifdef __raw_file_mmap__
+			int descriptor=open(path, O_RDONLY);
+
+			if(descriptor<0)
+			{
+				return STATUS_FAIL;
+			}
+
+			struct stat info;
+
+			if(fstat(descriptor, &info)!=0 || info.st_size<=0)
+			{
+				close(descriptor);
+				return STATUS_FAIL;
+			}
+
+			void* address=mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+			close(descriptor);
+
+			if(address==MAP_FAILED)
+			{
+				return STATUS_FAIL;
+			}
+
+			// rows are read once, front to back
+			madvise(address, (size_t)info.st_size, MADV_SEQUENTIAL);
+
+			Data=(const uint8_t*)address;
+			Size=(size_t)info.st_size;
+			Mapped=true;
+#else
+			FILE* file=fopen(path, "rb");
+
+			if(file==nullptr)
+			{
+				return STATUS_FAIL;
+			}
+
+			fseek(file, 0, SEEK_END);
+			long length=ftell(file);
+			fseek(file, 0, SEEK_SET);
+
+			if(length<=0)
+			{
+				fclose(file);
+				return STATUS_FAIL;
+			}
+
+			Buffer.resize((size_t)length);
+			size_t read=fread(Buffer.data(), 1, Buffer.size(), file);
+			fclose(file);
+
+			if(read!=Buffer.size())
+			{
+				Buffer.clear();
+				return STATUS_FAIL;
+			}
+
+			Data=Buffer.data();
+			Size=Buffer.size();
+#endif
+
+			return STATUS_OK;
+		}
+
+		void Close()
+		{
+#ifdef __raw_file_mmap__
+			if(Mapped)
+			{
+				munmap((void*)Data, Size);
+			}
+#endif
+			Buffer.clear();
+			Data=nullptr;
+			Size=0;
+			Mapped=false;
+			ResetLayout();
+		}
+
+		// Sensor data of the opened file: height rows of width pixels in format, starting at offset bytes,
+		// row_stride=0 - rows follow each other without padding. Fails on a closed file, an empty frame
+		// or data that does not fit the file; the previous layout is kept then
+		int SetLayout(size_t offset, unsigned int width, unsigned int height, unsigned int format, size_t row_stride=0)
+		{
+			if(Data==nullptr || GetPackedBits(format)==0 || width==0 || height==0)
+			{
+				return STATUS_FAIL;
+			}
+
+			size_t row_bytes=GetPackedRowBytes(format, width);
+			row_stride=row_stride==0 ? row_bytes : row_stride;
+
+			// written without sums, which could wrap for offsets and strides near SIZE_MAX
+			if(row_stride<row_bytes || offset>Size || row_bytes>Size-offset ||
+				(height>1 && (Size-offset-row_bytes)/row_stride<(size_t)(height-1)))
+			{
+				return STATUS_FAIL;
+			}
+
+			Offset=offset;
+			Width=width;
+			Height=height;
+			Format=format;
+			RowStride=row_stride;
+
+			return STATUS_OK;
+		}
+
+		// Reads the sensor data into memory now (one byte per page), so that later passes do not wait for the disk
+		void Prefetch() const
+		{
+			if(!HasLayout())
+			{
+				return;
+			}
+
+			const uint8_t* begin=Data+Offset;
+			size_t size=(size_t)(Height-1)*RowStride+GetPackedRowBytes(Format, Width);
+			size_t page=GetPageSize();
+
+#ifdef __raw_file_mmap__
+			if(Mapped)
+			{
+				// madvise needs a page aligned address
+				size_t skew=(size_t)(begin-Data)%page;
+
+				madvise((void*)(begin-skew), size+skew, MADV_WILLNEED);
+			}
+#endif
+
+			volatile uint8_t sink=0;
+
+			for(size_t i=0;i<size;i+=page)
+			{
+				sink=sink+begin[i];
+			}
+		}
+
+		const uint8_t* GetData() const
+		{
+			return Data;
+		}
+
+		size_t GetSize() const
+		{
+			return Size;
+		}
+
+		const uint8_t* GetRow(unsigned int y) const
+		{
+			return Data+Offset+(size_t)y*RowStride;
+		}
+
+		unsigned int GetWidth() const
+		{
+			return Width;
+		}
+
+		unsigned int GetHeight() const
+		{
+			return Height;
+		}
+
+		unsigned int GetFormat() const
+		{
+			return Format;
+		}
+
+		size_t GetRowStride() const
+		{
+			return RowStride;
+		}
+
+		bool IsOpen() const
+		{
+			return Data!=nullptr;
+		}
+
+		// The file is open and SetLayout has succeeded since it was opened: every row lies inside the file
+		bool HasLayout() const
+		{
+			return Data!=nullptr && Width>0 && Height>0;
+		}
+
+	private:
+		void ResetLayout()
+		{
+			Offset=0;
+			Width=0;
+			Height=0;
+			Format=Plain16LE;
+			RowStride=0;
+		}
+
+		// the page size of the system where it is known, otherwise the common 4 KB
+		static size_t GetPageSize()
+		{
+#ifdef __raw_file_mmap__
+			long page=sysconf(_SC_PAGESIZE);
+
+			if(page>0)
+			{
+				return (size_t)page;
+			}
+#endif
+			return 4096;
+		}
+
+		const uint8_t*			Data;
+		size_t					Size;
+		bool					Mapped;
+		std::vector<uint8_t>	Buffer;
+
+		size_t					Offset;
+		unsigned int			Width;
+		unsigned int			Height;
+		unsigned int			Format;
+		size_t					RowStride;
+	};
+}
+
+#endif
@@ -0,0 +1,241 @@
+#ifndef __resize__
+#define __resize__
+
+#include <cmath>
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+
+#include "cubic_interpolate.h"
+#include "parallel.h"
+
+namespace maxssau
+{
+
+	// Ядро передискретизации
+	enum ResizeKernel
+	{
+		ResizeCubic=0,		// кубическая свёртка, a = -0.75
+		ResizeCatmullRom=1,	// кубическая свёртка, a = -0.5
+		ResizeLanczos2=2,
+		ResizeLanczos3=3
+	};
+
+	// Ядро кубической свёртки (Keys) с носителем [-2, 2]:
+	// a = -0.5 - Catmull-Rom, a = -0.75 - кубическая свёртка как в OpenCV
+	template <typename T>
+	inline T cubicConvolutionKernel(T x, T a) {
+		x = std::abs(x);
+		
+		if (x < T(1)) {
+			return ((a + 2.0) * x - (a + 3.0)) * x * x + 1.0;
+		}
+		if (x < T(2)) {
+			return ((a * x - 5.0 * a) * x + 8.0 * a) * x - 4.0 * a;
+		}
+		return T(0);
+	}
+
+	// Радиус носителя ядра в пикселях исходного изображения (при увеличении)
+	inline double resizeKernelRadius(ResizeKernel kernel) {
+		return kernel == ResizeLanczos3 ? 3.0 : 2.0;
+	}
+
+	inline double resizeKernelWeight(ResizeKernel kernel, double x) {
+		switch (kernel) {
+		case ResizeCubic:
+			return cubicConvolutionKernel(x, -0.75);
+
+		case ResizeCatmullRom:
+			return cubicConvolutionKernel(x, -0.5);
+
+		default:
+			break;
+		}
+
+		double radius = resizeKernelRadius(kernel);
+		x = std::abs(x);
+
+		if (x >= radius) {
+			return 0.0;
+		}
+		if (x < 1e-8) {
+			return 1.0;
+		}
+
+		double px = M_PI * x;
+		return radius * std::sin(px) * std::sin(px / radius) / (px * px);
+	}
+
+	// Таблица весов для одной оси: для каждого выходного пикселя taps весов,
+	// начиная с входного пикселя first[i]. Выход за границы изображения
+	// сворачивается на крайние пиксели, сумма весов равна 1
+	struct ResizeWeights {
+		size_t taps;
+		std::vector<size_t> first;
+		std::vector<float> weights;
+	};
+
+	// Центры пикселей совмещаются: x_in = (x_out + 0.5) * in / out - 0.5.
+	// При уменьшении ядро растягивается в in/out раз (фильтрация от наложения спектров)
+	inline ResizeWeights buildResizeWeights(size_t in_size, size_t out_size, ResizeKernel kernel) {
+		double scale = double(in_size) / double(out_size);
+		double stretch = std::max(1.0, scale);
+		double radius = resizeKernelRadius(kernel) * stretch;
+
+		ResizeWeights result;
+		result.taps = std::min(size_t(std::ceil(2.0 * radius)) + 1, in_size);
+		result.first.resize(out_size);
+		result.weights.assign(out_size * result.taps, 0.0f);
+
+		std::vector<double> accumulated(result.taps);
+
+		for (size_t o = 0; o < out_size; ++o) {
+			double center = (o + 0.5) * scale - 0.5;
+			long long k0 = (long long)std::floor(center - radius) + 1;
+			long long k1 = (long long)std::floor(center + radius);
+			long long start = std::min(std::max(k0, 0LL), (long long)(in_size - result.taps));
+
+			std::fill(accumulated.begin(), accumulated.end(), 0.0);
+			double sum = 0.0;
+
+			for (long long k = k0; k <= k1; ++k) {
+				double w = resizeKernelWeight(kernel, (k - center) / stretch);
+				long long c = std::min(std::max(k, 0LL), (long long)in_size - 1);
+
+				accumulated[c - start] += w;
+				sum += w;
+			}
+
+			result.first[o] = size_t(start);
+
+			for (size_t t = 0; t < result.taps; ++t) {
+				result.weights[o * result.taps + t] = float(sum != 0.0 ? accumulated[t] / sum : 0.0);
+			}
+		}
+
+		return result;
+	}
+
+	// Раздельная передискретизация изображения с чередующимися каналами:
+	// горизонтальный проход в буфер float, затем вертикальный. Таблицы весов
+	// строятся один раз в конструкторе и используются для всех кадров этого размера.
+	// Выход делится на полосы строк; для каждой полосы поток фильтрует по горизонтали
+	// только нужные ей входные строки в свой буфер, рабочий набор ограничен размером полосы
+	template <typename TypeIn, typename TypeOut>
+	class ImageResizer {
+	private:
+		size_t in_width;
+		size_t in_height;
+		size_t out_width;
+		size_t out_height;
+		size_t channels;
+
+		ResizeWeights horizontal;
+		ResizeWeights vertical;
+
+		// Строк выхода в одной полосе
+		static constexpr size_t band_rows = 32;
+
+	public:
+		// output_scale умножает результат, например 255.0 / 65535.0 для 16-битного входа и 8-битного выхода;
+		// масштаб входит в вертикальные веса и не стоит ничего на пиксель
+		ImageResizer(size_t input_width, size_t input_height, size_t output_width, size_t output_height,
+			size_t channels_count, ResizeKernel kernel = ResizeCatmullRom, float output_scale = 1.0f)
+			: in_width(input_width), in_height(input_height), out_width(output_width), out_height(output_height),
+			channels(channels_count)
+		{
+			if (in_width == 0 || in_height == 0 || out_width == 0 || out_height == 0 || channels == 0) {
+				throw std::invalid_argument("Image dimensions cannot be zero");
+			}
+
+			horizontal = buildResizeWeights(in_width, out_width, kernel);
+			vertical = buildResizeWeights(in_height, out_height, kernel);
+
+			for (float& weight : vertical.weights) {
+				weight *= output_scale;
+			}
+		}
+
+		// input - in_height строк по in_width * channels, output - out_height строк по out_width * channels
+		void resize(const TypeIn* input, TypeOut* output, unsigned int threads = 1) const {
+			size_t bands = (out_height + band_rows - 1) / band_rows;
+			threads = GetThreadsCount(bands, threads, 1);
+
+			ParallelFor(bands, threads, [&](size_t begin, size_t end, unsigned int) {
+				size_t row_size = out_width * channels;
+				std::vector<float> buffer;
+				std::vector<float> accumulator(row_size);
+
+				for (size_t band = begin; band < end; ++band) {
+					size_t row_first = band * band_rows;
+					size_t row_last = std::min(row_first + band_rows, out_height);
+
+					// входные строки, которые нужны полосе
+					size_t source_first = vertical.first[row_first];
+					size_t source_last = vertical.first[row_last - 1] + vertical.taps;
+
+					buffer.resize((source_last - source_first) * row_size);
+
+					for (size_t y = source_first; y < source_last; ++y) {
+						filterRow(input + y * in_width * channels, &buffer[(y - source_first) * row_size]);
+					}
+
+					for (size_t row = row_first; row < row_last; ++row) {
+						const float* weights = &vertical.weights[row * vertical.taps];
+						const float* source = &buffer[(vertical.first[row] - source_first) * row_size];
+
+						std::fill(accumulator.begin(), accumulator.end(), 0.0f);
+
+						for (size_t t = 0; t < vertical.taps; ++t) {
+							float w = weights[t];
+							const float* line = source + t * row_size;
+
+							for (size_t i = 0; i < row_size; ++i) {
+								accumulator[i] += w * line[i];
+							}
+						}
+
+						TypeOut* out = output + row * row_size;
+						for (size_t i = 0; i < row_size; ++i) {
+							out[i] = saturateCast<TypeOut>(accumulator[i]);
+						}
+					}
+				}
+			});
+		}
+
+		void resize(const std::vector<TypeIn>& input, std::vector<TypeOut>& output, unsigned int threads = 1) const {
+			if (input.size() != in_width * in_height * channels) {
+				throw std::invalid_argument("Input size does not match resizer dimensions");
+			}
+
+			output.resize(out_width * out_height * channels);
+			resize(input.data(), output.data(), threads);
+		}
+
+	private:
+		void filterRow(const TypeIn* source, float* destination) const {
+			size_t taps = horizontal.taps;
+
+			for (size_t o = 0; o < out_width; ++o) {
+				const float* weights = &horizontal.weights[o * taps];
+				const TypeIn* pixel = source + horizontal.first[o] * channels;
+				float* out = destination + o * channels;
+
+				for (size_t c = 0; c < channels; ++c) {
+					float sum = 0.0f;
+
+					for (size_t t = 0; t < taps; ++t) {
+						sum += weights[t] * float(pixel[t * channels + c]);
+					}
+
+					out[c] = sum;
+				}
+			}
+		}
+	};
+
+}
+
+#endif
@@ -0,0 +1,278 @@
+#ifndef __spline__fit__
+#define __spline__fit__
+
+#include <cmath>
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+
+#include "cubic_interpolate.h"
+#include "minmax.h"
+#include "parallel.h"
+
+namespace maxssau
+{
+
+	// Решение симметричной положительно определённой ленточной системы разложением Холецкого.
+	// band[i * (bandwidth + 1) + k] = A(i, i - k), k = 0..bandwidth; на выходе - множитель L.
+	// rhs заменяется решением; false, если матрица вырождена
+	template <typename T>
+	bool solveBandedSymmetric(std::vector<T>& band, size_t n, size_t bandwidth, std::vector<T>& rhs) {
+		size_t stride = bandwidth + 1;
+		T scale = T(0);
+
+		for (size_t i = 0; i < n; ++i) {
+			scale = std::max(scale, std::abs(band[i * stride]));
+		}
+
+		for (size_t i = 0; i < n; ++i) {
+			size_t first = i > bandwidth ? i - bandwidth : 0;
+
+			for (size_t j = first; j <= i; ++j) {
+				T sum = band[i * stride + (i - j)];
+
+				for (size_t m = std::max(first, j > bandwidth ? j - bandwidth : 0); m < j; ++m) {
+					sum -= band[i * stride + (i - m)] * band[j * stride + (j - m)];
+				}
+
+				if (j < i) {
+					band[i * stride + (i - j)] = sum / band[j * stride];
+				}
+				else {
+					if (!(sum > scale * std::numeric_limits<T>::epsilon())) {
+						return false;
+					}
+					band[i * stride] = std::sqrt(sum);
+				}
+			}
+		}
+
+		// L z = b
+		for (size_t i = 0; i < n; ++i) {
+			T sum = rhs[i];
+			for (size_t k = 1; k <= bandwidth && k <= i; ++k) {
+				sum -= band[i * stride + k] * rhs[i - k];
+			}
+			rhs[i] = sum / band[i * stride];
+		}
+
+		// L^T x = z
+		for (size_t i = n; i > 0; --i) {
+			T sum = rhs[i - 1];
+			for (size_t k = 1; k <= bandwidth && i - 1 + k < n; ++k) {
+				sum -= band[(i - 1 + k) * stride + k] * rhs[i - 1 + k];
+			}
+			rhs[i - 1] = sum / band[(i - 1) * stride];
+		}
+
+		return true;
+	}
+
+	// Сглаживающий сплайн (Reinsch): минимизирует sum w_i (y_i - g(x_i))^2 + smoothing * int g''^2.
+	// x строго возрастает, weights пустой - все веса 1. Пятидиагональная система решается за O(n);
+	// результат - естественный сплайн через сглаженные значения во всех n узлах
+	template <typename T>
+	CubicInterpolator<T> fitSmoothingSpline(const std::vector<T>& x, const std::vector<T>& y, T smoothing,
+		const std::vector<T>& weights = std::vector<T>())
+	{
+		size_t n = x.size();
+
+		if (y.size() != n || (!weights.empty() && weights.size() != n)) {
+			throw std::invalid_argument("x, y and weights arrays must have the same size");
+		}
+		if (n < 3) {
+			throw std::invalid_argument("At least 3 points are required for smoothing");
+		}
+		if (smoothing < T(0)) {
+			throw std::invalid_argument("Smoothing cannot be negative");
+		}
+
+		std::vector<T> h(n - 1);
+		std::vector<T> inverse_weight(n, T(1));
+
+		for (size_t i = 0; i < n - 1; ++i) {
+			h[i] = x[i + 1] - x[i];
+			if (!(h[i] > T(0))) {
+				throw std::invalid_argument("x values must be strictly increasing");
+			}
+		}
+
+		for (size_t i = 0; i < weights.size(); ++i) {
+			if (!(weights[i] > T(0))) {
+				throw std::invalid_argument("Weights must be positive");
+			}
+			inverse_weight[i] = T(1) / weights[i];
+		}
+
+		// Q - n x (n - 2), столбец j (узел j + 1) содержит q0, q1, q2 в строках j, j + 1, j + 2
+		size_t m = n - 2;
+		std::vector<T> q0(m);
+		std::vector<T> q1(m);
+		std::vector<T> q2(m);
+
+		for (size_t j = 0; j < m; ++j) {
+			q0[j] = T(1) / h[j];
+			q2[j] = T(1) / h[j + 1];
+			q1[j] = -q0[j] - q2[j];
+		}
+
+		// A = R + smoothing * Q^T W^-1 Q, полоса ширины 2; правая часть Q^T y
+		std::vector<T> band(m * 3, T(0));
+		std::vector<T> gamma(m);
+
+		for (size_t j = 0; j < m; ++j) {
+			band[j * 3] = (h[j] + h[j + 1]) / T(3) + smoothing * (q0[j] * q0[j] * inverse_weight[j] +
+				q1[j] * q1[j] * inverse_weight[j + 1] + q2[j] * q2[j] * inverse_weight[j + 2]);
+
+			if (j >= 1) {
+				band[j * 3 + 1] = h[j] / T(6) + smoothing * (q0[j] * q1[j - 1] * inverse_weight[j] +
+					q1[j] * q2[j - 1] * inverse_weight[j + 1]);
+			}
+			if (j >= 2) {
+				band[j * 3 + 2] = smoothing * q0[j] * q2[j - 2] * inverse_weight[j];
+			}
+
+			gamma[j] = q0[j] * y[j] + q1[j] * y[j + 1] + q2[j] * y[j + 2];
+		}
+
+		if (!solveBandedSymmetric(band, m, 2, gamma)) {
+			throw std::invalid_argument("Smoothing spline system is singular");
+		}
+
+		// g = y - smoothing * W^-1 Q gamma
+		std::vector<T> g(y);
+
+		for (size_t j = 0; j < m; ++j) {
+			g[j] -= smoothing * inverse_weight[j] * q0[j] * gamma[j];
+			g[j + 1] -= smoothing * inverse_weight[j + 1] * q1[j] * gamma[j];
+			g[j + 2] -= smoothing * inverse_weight[j + 2] * q2[j] * gamma[j];
+		}
+
+		return CubicInterpolator<T>(x, g);
+	}
+
+	// Сплайн наименьших квадратов: кубический B-сплайн на knots_count равномерных узлах
+	// по диапазону x (порядок x произвольный). smoothing > 0 добавляет штраф на вторые
+	// разности коэффициентов (P-сплайн), что устраняет вырожденность при пустых интервалах.
+	// Нормальные уравнения накапливаются за один проход O(n) (threads - как в MinMax),
+	// ленточная система размера knots_count + 2 решается за O(knots_count).
+	// Результат - SplineClamped с knots_count узлами, совпадающий с B-сплайном
+	template <typename T>
+	CubicInterpolator<T> fitLeastSquaresSpline(const std::vector<T>& x, const std::vector<T>& y, size_t knots_count,
+		T smoothing = T(0), const std::vector<T>& weights = std::vector<T>(), unsigned int threads = 1)
+	{
+		size_t n = x.size();
+
+		if (y.size() != n || (!weights.empty() && weights.size() != n)) {
+			throw std::invalid_argument("x, y and weights arrays must have the same size");
+		}
+		if (knots_count < 2) {
+			throw std::invalid_argument("At least 2 knots are required");
+		}
+		if (smoothing < T(0)) {
+			throw std::invalid_argument("Smoothing cannot be negative");
+		}
+		if (n == 0) {
+			throw std::invalid_argument("No data to fit");
+		}
+
+		MinMax<T> range;
+		range.Calculate(x, threads);
+
+		T x_first = range.GetMinValue();
+		T x_last = range.GetMaxValue();
+
+		if (!(x_last > x_first)) {
+			throw std::invalid_argument("x values must not all be equal");
+		}
+
+		size_t intervals = knots_count - 1;
+		size_t basis = knots_count + 2;
+		T step = (x_last - x_first) / T(intervals);
+		T inverse_step = T(1) / step;
+
+		// Частичные нормальные уравнения потоков: полоса ширины 3 и правая часть
+		threads = GetThreadsCount(n, threads, 1 << 16);
+		std::vector<std::vector<T>> partial_band(threads, std::vector<T>(basis * 4, T(0)));
+		std::vector<std::vector<T>> partial_rhs(threads, std::vector<T>(basis, T(0)));
+
+		ParallelFor(n, threads, [&](size_t begin, size_t end, unsigned int index) {
+			T* band = partial_band[index].data();
+			T* rhs = partial_rhs[index].data();
+
+			for (size_t s = begin; s < end; ++s) {
+				T position = (x[s] - x_first) * inverse_step;
+				size_t i = std::min(size_t(position), intervals - 1);
+				T u = position - T(i);
+				T v = T(1) - u;
+				T w = weights.empty() ? T(1) : weights[s];
+
+				// Ненулевые базисные функции i..i+3
+				T b[4] = {
+					v * v * v / T(6),
+					(T(3) * u * u * u - T(6) * u * u + T(4)) / T(6),
+					(T(-3) * u * u * u + T(3) * u * u + T(3) * u + T(1)) / T(6),
+					u * u * u / T(6)
+				};
+
+				for (size_t r = 0; r < 4; ++r) {
+					T wb = w * b[r];
+					rhs[i + r] += wb * y[s];
+
+					for (size_t c = 0; c <= r; ++c) {
+						band[(i + r) * 4 + (r - c)] += wb * b[c];
+					}
+				}
+			}
+		});
+
+		std::vector<T> band(partial_band[0]);
+		std::vector<T> coefficients(partial_rhs[0]);
+
+		for (unsigned int t = 1; t < threads; ++t) {
+			for (size_t i = 0; i < band.size(); ++i) {
+				band[i] += partial_band[t][i];
+			}
+			for (size_t i = 0; i < basis; ++i) {
+				coefficients[i] += partial_rhs[t][i];
+			}
+		}
+
+		// smoothing * D^T D, D - вторые разности: строка (1, -2, 1) на коэффициентах j..j+2
+		if (smoothing > T(0)) {
+			const T difference[3] = {T(1), T(-2), T(1)};
+
+			for (size_t j = 0; j + 2 < basis; ++j) {
+				for (size_t r = 0; r < 3; ++r) {
+					for (size_t c = 0; c <= r; ++c) {
+						band[(j + r) * 4 + (r - c)] += smoothing * difference[r] * difference[c];
+					}
+				}
+			}
+		}
+
+		if (!solveBandedSymmetric(band, basis, 3, coefficients)) {
+			throw std::invalid_argument("Not enough data for the knot count, increase smoothing or reduce knots");
+		}
+
+		// Значения в узлах и производные на концах однозначно задают тот же C2 кубический сплайн
+		std::vector<T> knots(knots_count);
+		std::vector<T> values(knots_count);
+
+		for (size_t i = 0; i < knots_count; ++i) {
+			knots[i] = x_first + step * T(i);
+			values[i] = (coefficients[i] + T(4) * coefficients[i + 1] + coefficients[i + 2]) / T(6);
+		}
+		knots.back() = x_last;
+
+		CubicInterpolator<T> result(knots, values);
+		result.setSplineType(SplineClamped);
+		result.setBoundaryDerivatives((coefficients[2] - coefficients[0]) * inverse_step / T(2),
+			(coefficients[basis - 1] - coefficients[basis - 3]) * inverse_step / T(2));
+
+		return result;
+	}
+
+}
+
+#endif
@@ -0,0 +1,586 @@
+#ifndef __statistics__
+#define __statistics__
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "minmax.h"
+#include "parallel.h"
+
+namespace maxssau
+{
+    // Quantile sketch with relative accuracy guarantee (DDSketch):
+    // values are counted in logarithmic buckets, so any quantile is returned
+    // with relative error not worse than relative_accuracy, memory depends only on the value range.
+    // Sketches with equal accuracy can be merged.
+    class QuantileSketch
+    {
+    public:
+        QuantileSketch(double relative_accuracy = 0.01)
+        {
+            if (relative_accuracy <= 0.0 || relative_accuracy >= 1.0)
+            {
+                throw std::invalid_argument("Relative accuracy must be in (0, 1)");
+            }
+
+            RelativeAccuracy = relative_accuracy;
+            Gamma = (1.0 + relative_accuracy) / (1.0 - relative_accuracy);
+            Multiplier = 1.0 / std::log(Gamma);
+            Reset();
+        }
+
+        void Add(double value, uint64_t count = 1)
+        {
+            if (value > MinIndexable)
+            {
+                Positive.Add(Key(value), count);
+            }
+            else if (value < -MinIndexable)
+            {
+                Negative.Add(Key(-value), count);
+            }
+            else
+            {
+                ZeroCount += count;
+            }
+
+            Count += count;
+        }
+
+        // Bulk version of Add: keys of a chunk are computed by a separate loop without branches (one logarithm
+        // per value, the main cost), then bucket ranges are reserved once and counters are updated
+        template <typename Type>
+        void Add(const Type* values, size_t count)
+        {
+            int keys[KeyChunk];
+
+            for (size_t begin = 0; begin < count; begin += KeyChunk)
+            {
+                size_t length = count - begin < KeyChunk ? count - begin : KeyChunk;
+                const Type* chunk = values + begin;
+
+                for (size_t i = 0; i < length; i++)
+                {
+                    double magnitude = std::fabs((double)chunk[i]);
+                    keys[i] = Key(magnitude > MinIndexable ? magnitude : MinIndexable);
+                }
+
+                int positive_min = std::numeric_limits<int>::max();
+                int positive_max = std::numeric_limits<int>::min();
+                int negative_min = std::numeric_limits<int>::max();
+                int negative_max = std::numeric_limits<int>::min();
+
+                for (size_t i = 0; i < length; i++)
+                {
+                    double value = (double)chunk[i];
+
+                    if (value > MinIndexable)
+                    {
+                        positive_min = keys[i] < positive_min ? keys[i] : positive_min;
+                        positive_max = keys[i] > positive_max ? keys[i] : positive_max;
+                    }
+                    else if (value < -MinIndexable)
+                    {
+                        negative_min = keys[i] < negative_min ? keys[i] : negative_min;
+                        negative_max = keys[i] > negative_max ? keys[i] : negative_max;
+                    }
+                }
+
+                if (positive_min <= positive_max)
+                {
+                    Positive.Reserve(positive_min, positive_max);
+                }
+
+                if (negative_min <= negative_max)
+                {
+                    Negative.Reserve(negative_min, negative_max);
+                }
+
+                for (size_t i = 0; i < length; i++)
+                {
+                    double value = (double)chunk[i];
+
+                    if (value > MinIndexable)
+                    {
+                        Positive.Counts[keys[i] - Positive.Offset]++;
+                    }
+                    else if (value < -MinIndexable)
+                    {
+                        Negative.Counts[keys[i] - Negative.Offset]++;
+                    }
+                    else
+                    {
+                        ZeroCount++;
+                    }
+                }
+
+                Count += length;
+            }
+        }
+
+        void Merge(const QuantileSketch& other)
+        {
+            if (other.RelativeAccuracy != RelativeAccuracy)
+            {
+                throw std::invalid_argument("Sketches must have the same relative accuracy");
+            }
+
+            Positive.Merge(other.Positive);
+            Negative.Merge(other.Negative);
+            ZeroCount += other.ZeroCount;
+            Count += other.Count;
+        }
+
+        // q in [0, 1]
+        double GetQuantile(double q) const
+        {
+            if (Count == 0)
+            {
+                return std::numeric_limits<double>::quiet_NaN();
+            }
+
+            q = q < 0.0 ? 0.0 : (q > 1.0 ? 1.0 : q);
+
+            uint64_t rank = (uint64_t)(q * (double)(Count - 1));
+            uint64_t passed = 0;
+
+            // negative values: largest magnitude first
+            for (size_t i = Negative.Counts.size(); i > 0; i--)
+            {
+                passed += Negative.Counts[i - 1];
+                if (passed > rank)
+                {
+                    return -Value(Negative.Offset + (int)(i - 1));
+                }
+            }
+
+            passed += ZeroCount;
+            if (passed > rank)
+            {
+                return 0.0;
+            }
+
+            for (size_t i = 0; i < Positive.Counts.size(); i++)
+            {
+                passed += Positive.Counts[i];
+                if (passed > rank)
+                {
+                    return Value(Positive.Offset + (int)i);
+                }
+            }
+
+            return Value(Positive.Offset + (int)Positive.Counts.size() - 1);
+        }
+
+        uint64_t GetCount() const
+        {
+            return Count;
+        }
+
+        double GetRelativeAccuracy() const
+        {
+            return RelativeAccuracy;
+        }
+
+        void Reset()
+        {
+            Positive = Buckets();
+            Negative = Buckets();
+            ZeroCount = 0;
+            Count = 0;
+        }
+
+    private:
+        // values closer to zero are counted as zero
+        static constexpr double MinIndexable = 1e-9;
+        static constexpr size_t KeyChunk = 1024;
+
+        struct Buckets
+        {
+            std::vector<uint64_t> Counts;
+            int Offset = 0;
+
+            void Add(int key, uint64_t count)
+            {
+                Reserve(key, key);
+                Counts[key - Offset] += count;
+            }
+
+            void Reserve(int min_key, int max_key)
+            {
+                if (Counts.empty())
+                {
+                    Offset = min_key;
+                    Counts.assign(max_key - min_key + 1, 0);
+                    return;
+                }
+
+                if (min_key < Offset)
+                {
+                    Counts.insert(Counts.begin(), Offset - min_key, 0);
+                    Offset = min_key;
+                }
+
+                int last = Offset + (int)Counts.size() - 1;
+
+                if (max_key > last)
+                {
+                    Counts.resize(Counts.size() + (max_key - last), 0);
+                }
+            }
+
+            void Merge(const Buckets& other)
+            {
+                if (other.Counts.empty())
+                {
+                    return;
+                }
+
+                Reserve(other.Offset, other.Offset + (int)other.Counts.size() - 1);
+
+                for (size_t i = 0; i < other.Counts.size(); i++)
+                {
+                    Counts[other.Offset - Offset + i] += other.Counts[i];
+                }
+            }
+        };
+
+        int Key(double magnitude) const
+        {
+            return (int)std::ceil(std::log(magnitude) * Multiplier);
+        }
+
+        double Value(int key) const
+        {
+            return 2.0 * std::pow(Gamma, key) / (1.0 + Gamma);
+        }
+
+        double RelativeAccuracy;
+        double Gamma;
+        double Multiplier;
+
+        Buckets Positive;
+        Buckets Negative;
+        uint64_t ZeroCount;
+        uint64_t Count;
+    };
+
+    // Single-pass statistics: count, min/max, mean, variance, skewness, kurtosis and quantiles.
+    // Central moments are accumulated with Welford/Pebay updates, so partial results
+    // collected on different threads or buffers are merged exactly.
+    // Quantiles are opt-in: every value then costs a logarithm for its sketch bucket,
+    // several times the cost of the moments.
+    template <typename ClassType>
+    class Statistics
+    {
+    public:
+        Statistics(bool use_quantiles = false, double relative_accuracy = 0.01)
+            : Sketch(relative_accuracy)
+        {
+            UseQuantiles = use_quantiles;
+            Reset();
+        }
+
+        void Calculate(ClassType value)
+        {
+            Extremes.Calculate(value);
+
+            if (UseQuantiles)
+            {
+                Sketch.Add((double)value);
+            }
+
+            double n1 = (double)Count;
+            Count++;
+            double n = (double)Count;
+
+            double delta = (double)value - Mean;
+            double delta_n = delta / n;
+            double delta_n2 = delta_n * delta_n;
+            double term = delta * delta_n * n1;
+
+            Mean += delta_n;
+            M4 += term * delta_n2 * (n * n - 3.0 * n + 3.0) + 6.0 * delta_n2 * M2 - 4.0 * delta_n * M3;
+            M3 += term * delta_n * (n - 2.0) - 3.0 * delta_n * M2;
+            M2 += term;
+        }
+
+        // Bulk update over count values, optionally split between threads (0 - all hardware threads)
+        void Calculate(const ClassType* data, size_t count, unsigned int threads = 1)
+        {
+            if (data == nullptr || count == 0)
+            {
+                return;
+            }
+
+            threads = GetThreadsCount(count, threads, ParallelMinChunk);
+
+            if (threads <= 1)
+            {
+                CalculateRange(data, count);
+                return;
+            }
+
+            std::vector<Statistics> partial(threads, Statistics(UseQuantiles, Sketch.GetRelativeAccuracy()));
+
+            ParallelFor(count, threads, [&](size_t begin, size_t end, unsigned int index)
+            {
+                partial[index].CalculateRange(data + begin, end - begin);
+            });
+
+            for (const auto& item : partial)
+            {
+                Merge(item);
+            }
+        }
+
+        void Calculate(const std::vector<ClassType>& data, unsigned int threads = 1)
+        {
+            Calculate(data.data(), data.size(), threads);
+        }
+
+        void Merge(const Statistics& other)
+        {
+            if (other.Count == 0)
+            {
+                return;
+            }
+
+            Extremes.Merge(other.Extremes);
+
+            if (UseQuantiles && other.UseQuantiles)
+            {
+                Sketch.Merge(other.Sketch);
+            }
+
+            MergeMoments(other.Count, other.Mean, other.M2, other.M3, other.M4);
+        }
+
+        uint64_t GetCount() const
+        {
+            return Count;
+        }
+
+        ClassType GetMinValue()
+        {
+            return Extremes.GetMinValue();
+        }
+
+        ClassType GetMaxValue()
+        {
+            return Extremes.GetMaxValue();
+        }
+
+        double GetMean() const
+        {
+            return Mean;
+        }
+
+        // population variance, sample=true gives the unbiased estimate
+        double GetVariance(bool sample = false) const
+        {
+            if (Count == 0 || (sample && Count < 2))
+            {
+                return 0.0;
+            }
+
+            return M2 / (double)(sample ? Count - 1 : Count);
+        }
+
+        double GetStandardDeviation(bool sample = false) const
+        {
+            return std::sqrt(GetVariance(sample));
+        }
+
+        double GetSkewness() const
+        {
+            if (M2 <= 0.0)
+            {
+                return 0.0;
+            }
+
+            return std::sqrt((double)Count) * M3 / std::pow(M2, 1.5);
+        }
+
+        // excess kurtosis (0 for normal distribution)
+        double GetKurtosis() const
+        {
+            if (M2 <= 0.0)
+            {
+                return 0.0;
+            }
+
+            return (double)Count * M4 / (M2 * M2) - 3.0;
+        }
+
+        // q in [0, 1], NaN if quantiles are disabled or no data
+        double GetQuantile(double q)
+        {
+            if (!UseQuantiles || Count == 0)
+            {
+                return std::numeric_limits<double>::quiet_NaN();
+            }
+
+            double value = Sketch.GetQuantile(q);
+            double min_value = (double)Extremes.GetMinValue();
+            double max_value = (double)Extremes.GetMaxValue();
+
+            return value < min_value ? min_value : (value > max_value ? max_value : value);
+        }
+
+        double GetPercentile(double percent)
+        {
+            return GetQuantile(percent / 100.0);
+        }
+
+        void Reset()
+        {
+            Extremes.Reset();
+            Sketch.Reset();
+            Count = 0;
+            Mean = 0.0;
+            M2 = 0.0;
+            M3 = 0.0;
+            M4 = 0.0;
+        }
+
+    private:
+        static constexpr size_t ParallelMinChunk = 1 << 18;
+        static constexpr size_t BlockSize = 2048;
+        static constexpr size_t Lanes = 8;
+
+        // Blocks stay in L1: block sum and central sums go to independent lanes, as in MinMax for
+        // floating types (a single double accumulator is an ordered reduction, which the compiler
+        // keeps scalar without -ffast-math), then the block is merged into the accumulator
+        void CalculateRange(const ClassType* data, size_t count)
+        {
+            for (size_t begin = 0; begin < count; begin += BlockSize)
+            {
+                size_t length = count - begin < BlockSize ? count - begin : BlockSize;
+                size_t lanes_length = length - length % Lanes;
+                const ClassType* block = data + begin;
+
+                Extremes.Calculate(block, length);
+
+                double lane_sum[Lanes] = {};
+
+                for (size_t i = 0; i < lanes_length; i += Lanes)
+                {
+                    for (size_t l = 0; l < Lanes; l++)
+                    {
+                        lane_sum[l] += (double)block[i + l];
+                    }
+                }
+
+                double sum = 0.0;
+                for (size_t i = lanes_length; i < length; i++)
+                {
+                    sum += (double)block[i];
+                }
+
+                for (size_t l = 0; l < Lanes; l++)
+                {
+                    sum += lane_sum[l];
+                }
+
+                double mean = sum / (double)length;
+                double lane_s2[Lanes] = {};
+                double lane_s3[Lanes] = {};
+                double lane_s4[Lanes] = {};
+
+                for (size_t i = 0; i < lanes_length; i += Lanes)
+                {
+                    for (size_t l = 0; l < Lanes; l++)
+                    {
+                        double d = (double)block[i + l] - mean;
+                        double d2 = d * d;
+
+                        lane_s2[l] += d2;
+                        lane_s3[l] += d2 * d;
+                        lane_s4[l] += d2 * d2;
+                    }
+                }
+
+                double s2 = 0.0;
+                double s3 = 0.0;
+                double s4 = 0.0;
+
+                for (size_t i = lanes_length; i < length; i++)
+                {
+                    double d = (double)block[i] - mean;
+                    double d2 = d * d;
+
+                    s2 += d2;
+                    s3 += d2 * d;
+                    s4 += d2 * d2;
+                }
+
+                for (size_t l = 0; l < Lanes; l++)
+                {
+                    s2 += lane_s2[l];
+                    s3 += lane_s3[l];
+                    s4 += lane_s4[l];
+                }
+
+                if (UseQuantiles)
+                {
+                    Sketch.Add(block, length);
+                }
+
+                MergeMoments(length, mean, s2, s3, s4);
+            }
+        }
+
+        void MergeMoments(uint64_t count_b, double mean_b, double m2_b, double m3_b, double m4_b)
+        {
+            if (Count == 0)
+            {
+                Count = count_b;
+                Mean = mean_b;
+                M2 = m2_b;
+                M3 = m3_b;
+                M4 = m4_b;
+                return;
+            }
+
+            double na = (double)Count;
+            double nb = (double)count_b;
+            double n = na + nb;
+
+            double delta = mean_b - Mean;
+            double delta_n = delta / n;
+            double delta_n2 = delta_n * delta_n;
+
+            double m2 = M2 + m2_b + delta * delta_n * na * nb;
+
+            double m3 = M3 + m3_b + delta * delta_n2 * na * nb * (na - nb)
+                + 3.0 * delta_n * (na * m2_b - nb * M2);
+
+            double m4 = M4 + m4_b + delta * delta_n2 * delta_n * na * nb * (na * na - na * nb + nb * nb)
+                + 6.0 * delta_n2 * (na * na * m2_b + nb * nb * M2)
+                + 4.0 * delta_n * (na * m3_b - nb * M3);
+
+            Count += count_b;
+            Mean += nb * delta_n;
+            M2 = m2;
+            M3 = m3;
+            M4 = m4;
+        }
+
+        MinMax<ClassType> Extremes;
+        QuantileSketch Sketch;
+        bool UseQuantiles;
+
+        uint64_t Count;
+        double Mean;
+        double M2;
+        double M3;
+        double M4;
+    };
+}
+
+#endif
@@ -1,11 +1,82 @@
 #define __use__cubic__interpolation__
 
 #include <stdio.h>
+#include <math.h>
+#include <vector>
 #include "../maxssau/maxssau.h"
 
 using namespace maxssau;
 
 int main(int arg_count,char* arg_values[])
 {
+	std::vector<double> x;
+	std::vector<double> y;
+
+	for(int i=0;i<=16;i++)
+	{
+		x.push_back(i*0.25);
+		y.push_back(sin(i*0.25));
+	}
+
+	CubicInterpolator<double> spline(x,y);
+
+	printf("f(1.1)=%f sin(1.1)=%f\n",spline.interpolate(1.1),sin(1.1));
+
+	std::vector<double> xs(1 << 20);
+	std::vector<double> ys;
+
+	for(size_t i=0;i<xs.size();i++)
+	{
+		xs[i]=4.0*i/(xs.size()-1);
+	}
+
+	spline.interpolate(xs,ys,0);
+
+	double error=0;
+
+	for(size_t i=0;i<xs.size();i++)
+	{
+		error=fmax(error,fabs(ys[i]-sin(xs[i])));
+	}
+
+	printf("Batch max error=%e\n",error);
+
+	spline.compileLookupTable(4096);
+	printf("LUT f(1.1)=%f\n",spline.interpolateLookupTable(1.1));
+
+	std::vector<unsigned char> table=spline.buildIntegerTable<unsigned char>(4,0.25,255.0);
+	printf("Integer table[4]=%i\n",table[4]);
+
+	CubicInterpolator<double> online;
+	online.setIncrementalMode(true,16);
+
+	for(int i=0;i<1000;i++)
+	{
+		double xi=(i*7919)%1000*0.01;
+		online.addPoint(xi,sin(xi));
+	}
+
+	printf("Incremental f(1.1)=%f\n",online.interpolate(1.1));
+
+	CubicInterpolator<double> tone({0.0,0.25,0.5,0.75,1.0},{0.0,0.02,0.9,0.95,1.0});
+
+	for(int type=SplineNatural;type<=SplineAkima;type++)
+	{
+		if(type==SplinePeriodic)
+		{
+			continue;
+		}
+
+		tone.setSplineType((SplineType)type);
+		printf("Spline type %i f(0.2)=%f\n",type,tone.interpolate(0.2));
+	}
+
+	CubicEvaluator<double> frozen=spline.compile(ExtrapolateLinear);
+	printf("Evaluator f(1.1)=%f f(-0.5)=%f f(4.5)=%f\n",frozen(1.1),frozen(-0.5),frozen(4.5));
+
+	// clamped ends: +-inf give the end values, not 0*inf
+	CubicEvaluator<double> clamped=spline.compile(ExtrapolateClamp);
+	printf("Clamped f(-inf)=%f f(inf)=%f\n",clamped(-HUGE_VAL),clamped(HUGE_VAL));
+
 	return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,69 @@
+#define __use__grid__interpolation__
+
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include "../maxssau/maxssau.h"
+
+using namespace maxssau;
+
+int main(int arg_count,char* arg_values[])
+{
+	// Lens shading gain map 9x7 -> 64x48
+	std::vector<double> x;
+	std::vector<double> y;
+	std::vector<double> gain;
+
+	for(int i=0;i<9;i++)
+	{
+		x.push_back(i/8.0);
+	}
+
+	for(int j=0;j<7;j++)
+	{
+		y.push_back(j/6.0);
+	}
+
+	for(int j=0;j<7;j++)
+	{
+		for(int i=0;i<9;i++)
+		{
+			double r2=(x[i]-0.5)*(x[i]-0.5)+(y[j]-0.5)*(y[j]-0.5);
+			gain.push_back(1.0+r2);
+		}
+	}
+
+	BicubicInterpolator<double> map(x,y,gain);
+	std::vector<double> image;
+	map.resample(image,64,48,0);
+
+	printf("Gain center=%f corner=%f f(0.3,0.6)=%f\n",image[24*64+32],image[0],map.interpolate(0.3,0.6));
+
+	// Identity 3D LUT 5x5x5
+	std::vector<float> table;
+
+	for(int b=0;b<5;b++)
+	{
+		for(int g=0;g<5;g++)
+		{
+			for(int r=0;r<5;r++)
+			{
+				table.push_back(r/4.0f);
+				table.push_back(g/4.0f);
+				table.push_back(b/4.0f);
+			}
+		}
+	}
+
+	ColorLUT3D<float> lut(5,table);
+	float rgb[3]={0.1f,0.7f,0.33f};
+	float out[3];
+
+	lut.lookupTetrahedral(rgb,out);
+	printf("LUT tetrahedral %f %f %f\n",out[0],out[1],out[2]);
+
+	lut.lookupTrilinear(rgb,out);
+	printf("LUT trilinear %f %f %f\n",out[0],out[1],out[2]);
+
+	return 0;
+}
@@ -1,6 +1,7 @@
 #define __use__minmax__
 
 #include <stdio.h>
+#include <vector>
 #include "../maxssau/maxssau.h"
 
 using namespace maxssau;
@@ -18,5 +19,61 @@ int main(int arg_count,char* arg_values[])
     printf("Calc min=%i\n",calc.GetMinValue());
     printf("Calc max=%i\n",calc.GetMaxValue());
 
+    std::vector<float> frame(1 << 20);
+
+    for(size_t i=0;i<frame.size();i++)
+    {
+        frame[i]=(float)((i*7919)%100003)-50000.0f;
+    }
+
+    MinMax<float> bulk;
+    bulk.Calculate(frame,0);
+
+    printf("Bulk min=%f\n",bulk.GetMinValue());
+    printf("Bulk max=%f\n",bulk.GetMaxValue());
+
+    WindowMinMax<int> window(3);
+    DecayMinMax<int> decay(0.5);
+
+    int samples[]={5,1,9,2,3,4};
+
+    for(int i=0;i<6;i++)
+    {
+        window.Calculate(samples[i]);
+        decay.Calculate(samples[i]);
+    }
+
+    printf("Window min=%i\n",window.GetMinValue());
+    printf("Window max=%i\n",window.GetMaxValue());
+    printf("Decay min=%i\n",decay.GetMinValue());
+    printf("Decay max=%i\n",decay.GetMaxValue());
+
+    // unsigned time before the first window has passed
+    TimeWindowMinMax<int,unsigned int> recent(1000);
+    recent.Calculate(7,10);
+    recent.Calculate(3,20);
+
+    printf("Time window min=%i max=%i\n",recent.GetMinValue(),recent.GetMaxValue());
+
+    IndexedMinMax<float> indexed;
+    indexed.Calculate(frame.data(),frame.size(),0);
+
+    printf("Indexed min=%f at %zu\n",indexed.GetMinValue(),indexed.GetMinIndex());
+    printf("Indexed max=%f at %zu\n",indexed.GetMaxValue(),indexed.GetMaxIndex());
+
+    // dark frame: every value equals the initial maximum sentinel
+    std::vector<unsigned short> dark(10000,0);
+    IndexedMinMax<unsigned short> dark_extremes;
+    dark_extremes.Calculate(dark.data(),dark.size(),0);
+
+    printf("Dark min at %zu, max at %zu\n",dark_extremes.GetMinIndex(),dark_extremes.GetMaxIndex());
+
+    std::vector<IndexedValue<float>> hot=SelectTopK(frame.data(),frame.size(),5,true,0);
+
+    for(size_t i=0;i<hot.size();i++)
+    {
+        printf("Top[%zu]=%f at %zu\n",i,hot[i].Value,hot[i].Index);
+    }
+
     return 0;
 }
\ No newline at end of file
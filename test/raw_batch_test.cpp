@@ -0,0 +1,92 @@
+#define __use__raw__batch__
+
+#include "../maxssau/maxssau.h"
+
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+using namespace maxssau;
+
+// Writes frames_count synthetic 10-bit packed frames, converts them as one batch and compares
+// the first one with a conversion by raw_converter::Process
+int main()
+{
+	const unsigned int width=1024;
+	const unsigned int height=768;
+	const unsigned int frames_count=8;
+
+	std::vector<std::string> paths;
+	std::vector<unsigned char> data(GetPackedRowBytes(Packed10, width)*height);
+
+	for(unsigned int i=0;i<frames_count;i++)
+	{
+		for(size_t b=0;b<data.size();b++)
+		{
+			data[b]=(unsigned char)(b*7+i*31);
+		}
+
+		paths.push_back("/tmp/raw_batch_test_"+std::to_string(i)+".raw");
+
+		FILE* file=fopen(paths.back().c_str(), "wb");
+
+		if(file==nullptr)
+		{
+			return 1;
+		}
+
+		fwrite(data.data(), 1, data.size(), file);
+		fclose(file);
+	}
+
+	raw_batch_converter<unsigned short, unsigned char> batch;
+	batch.settings.convert_threads=2;
+	batch.settings.frame_threads=1;
+
+	std::atomic<unsigned int> encoded(0);
+	std::vector<unsigned char> first_image;
+
+	int status=batch.Run(paths,
+		[&](RawFile& file, size_t)
+		{
+			return file.SetLayout(0, width, height, Packed10);
+		},
+		[&](raw_batch_converter<unsigned short, unsigned char>::Frame& frame)
+		{
+			encoded++;
+
+			if(frame.Index==0)
+			{
+				first_image=frame.Image;
+			}
+
+			printf("Frame %zu: RGB[0][0]=%i %i %i\n", frame.Index, frame.Image[0], frame.Image[1], frame.Image[2]);
+			return STATUS_OK;
+		});
+
+	printf("Status=%i, encoded %u of %u\n", status, encoded.load(), frames_count);
+
+	// the same frame without the pipeline
+	RawFile file;
+	BayerStatistics<unsigned short> statistics;
+	std::vector<unsigned short> plane((size_t)width*height);
+	std::vector<unsigned char> image((size_t)width*height*3);
+
+	bool same=file.Open(paths[0].c_str())==STATUS_OK && file.SetLayout(0, width, height, Packed10)==STATUS_OK &&
+		batch.converter.Unpack(file, plane.data(), &statistics, 1)==STATUS_OK &&
+		batch.converter.Process(plane.data(), image.data(), statistics.GetMinMax(), height, width, 1, 10)==STATUS_OK &&
+		first_image.size()==image.size() && memcmp(first_image.data(), image.data(), image.size())==0;
+
+	printf("Frame 0 %s Process\n", same ? "matches" : "differs from");
+
+	file.Close();
+
+	for(const std::string& path : paths)
+	{
+		remove(path.c_str());
+	}
+
+	return status==STATUS_OK && encoded==frames_count && same ? 0 : 1;
+}
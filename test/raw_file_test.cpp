@@ -0,0 +1,245 @@
+#define __use__raw__
+
+#include "../maxssau/maxssau.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace maxssau;
+
+// Largest error of every demosaic mode and Bayer pattern on a mosaic sampled from a linear colour field,
+// which all of them have to reconstruct; the border around the tile is sampled from the same field
+static float GetDemosaicLinearFieldError()
+{
+	const unsigned int size=32;
+	const long stride=size+2*DemosaicBorder;
+	const unsigned int modes[3]={DemosaicBilinear, DemosaicMalvar, DemosaicEdgeDirected};
+	std::vector<float> mosaic((size_t)stride*stride);
+	std::vector<float> planes((size_t)size*size*3);
+	std::vector<float> scratch(GetDemosaicScratchSize(size, size));
+	float error=0.0f;
+
+	auto field=[](unsigned int channel, long x, long y)
+	{
+		return channel==ChannelR ? 1000.0f+3.0f*x+2.0f*y : (channel==ChannelB ? 1500.0f+2.0f*x-3.0f*y : 2000.0f-x+4.0f*y);
+	};
+
+	for(unsigned int mode : modes)
+	{
+		for(unsigned int pattern=BayerRGGB;pattern<=BayerGBRG;pattern++)
+		{
+			for(long y=-(long)DemosaicBorder;y<(long)(size+DemosaicBorder);y++)
+			{
+				for(long x=-(long)DemosaicBorder;x<(long)(size+DemosaicBorder);x++)
+				{
+					mosaic[(y+DemosaicBorder)*stride+x+DemosaicBorder]=field(GetBayerChannel(pattern, (unsigned int)x, (unsigned int)y), x, y);
+				}
+			}
+
+			DemosaicTile(mode, mosaic.data()+DemosaicBorder*stride+DemosaicBorder, stride, size, size, pattern,
+				planes.data(), planes.data()+size*size, planes.data()+2*size*size, size, scratch.data());
+
+			for(unsigned int y=0;y<size;y++)
+			{
+				for(unsigned int x=0;x<size;x++)
+				{
+					size_t i=(size_t)y*size+x;
+
+					error=std::max(error, std::fabs(planes[i]-field(ChannelR, x, y)));
+					error=std::max(error, std::fabs(planes[size*size+i]-field(ChannelG1, x, y)));
+					error=std::max(error, std::fabs(planes[2*size*size+i]-field(ChannelB, x, y)));
+				}
+			}
+		}
+	}
+
+	return error;
+}
+
+// raw_file_test [file offset width height format] - converts the sensor data of a raw file read in place,
+// without arguments a synthetic 12-bit packed frame is written and converted
+int main(int arg_count, char* arg_value[])
+{
+	const char* path="/tmp/raw_file_test.raw";
+	bool synthetic=arg_count<=5;
+	size_t offset=0;
+	unsigned int width=640;
+	unsigned int height=480;
+	unsigned int format=Packed12;
+
+	if(!synthetic)
+	{
+		path=arg_value[1];
+		offset=strtoul(arg_value[2], nullptr, 10);
+		width=atoi(arg_value[3]);
+		height=atoi(arg_value[4]);
+		format=atoi(arg_value[5]);
+	}
+	else
+	{
+		// 12-bit gradient: two pixels in three bytes
+		std::vector<unsigned char> data(GetPackedRowBytes(Packed12, width)*height);
+
+		for(unsigned int y=0;y<height;y++)
+		{
+			unsigned char* row=data.data()+(size_t)y*GetPackedRowBytes(Packed12, width);
+
+			for(unsigned int x=0;x<width;x+=2)
+			{
+				unsigned int v0=(x*4095/width) & 4095;
+				unsigned int v1=(y*4095/height) & 4095;
+
+				row[x/2*3+0]=(unsigned char)(v0>>4);
+				row[x/2*3+1]=(unsigned char)(v1>>4);
+				row[x/2*3+2]=(unsigned char)((v0 & 15) | ((v1 & 15)<<4));
+			}
+		}
+
+		FILE* file=fopen(path, "wb");
+
+		if(file==nullptr)
+		{
+			return 1;
+		}
+
+		fwrite(data.data(), 1, data.size(), file);
+		fclose(file);
+	}
+
+	float demosaic_error=GetDemosaicLinearFieldError();
+	printf("Demosaic linear field error %.4f\n", demosaic_error);
+
+	if(demosaic_error>0.004f)
+	{
+		std::cout << "Demosaic does not reconstruct a linear field" << std::endl;
+		return 1;
+	}
+
+	RawFile file;
+
+	if(file.SetLayout(offset, width, height, format)==STATUS_OK)
+	{
+		std::cout << "Layout accepted without a file" << std::endl;
+		return 1;
+	}
+
+	int opened=file.Open(path);
+
+	if(synthetic)
+	{
+		// the mapping stays valid after the file is removed
+		remove(path);
+	}
+
+	if(opened!=STATUS_OK || file.SetLayout(offset, width, height, format)!=STATUS_OK)
+	{
+		std::cout << "Can't open " << path << std::endl;
+		return 1;
+	}
+
+	if(file.SetLayout(offset, width, height+1, format)==STATUS_OK || file.SetLayout((size_t)-1, width, height, format)==STATUS_OK)
+	{
+		std::cout << "Layout past the end of the file accepted" << std::endl;
+		return 1;
+	}
+
+	std::vector<unsigned char> narrow((size_t)width*height);
+	raw_converter<unsigned char, unsigned char> narrow_converter;
+
+	if(narrow_converter.Unpack(file, narrow.data())==STATUS_OK)
+	{
+		std::cout << "Unpacked into a type narrower than the samples" << std::endl;
+		return 1;
+	}
+
+	raw_converter<unsigned short, unsigned char> converter;
+	std::vector<unsigned char> image((size_t)width*height*3);
+	MinMaxValues<unsigned short> range;
+	range.Min=0;
+	range.Max=4095;
+
+	if(converter.Process(file, image.data(), range, 0)!=STATUS_OK)
+	{
+		std::cout << "Conversion failed" << std::endl;
+		return 1;
+	}
+
+	std::vector<unsigned short> plane((size_t)width*height);
+	BayerStatistics<unsigned short> statistics;
+
+	if(converter.Unpack(file, plane.data(), &statistics, 0)==STATUS_OK)
+	{
+		printf("R %i..%i G %i..%i B %i..%i\n", statistics.Channel[ChannelR].Min, statistics.Channel[ChannelR].Max,
+			statistics.Channel[ChannelG1].Min, statistics.Channel[ChannelG1].Max,
+			statistics.Channel[ChannelB].Min, statistics.Channel[ChannelB].Max);
+	}
+
+	Matrix<float> gains(3, 1);
+	converter.settings.white_balance_mode=WhiteBalancePercentile;
+	converter.white_balance_target=98;
+
+	if(converter.EstimateWhiteBalance(plane.data(), range, height, width, gains, 0, GetPackedBits(format))==STATUS_OK)
+	{
+		printf("White balance %f %f %f\n", gains(0, 0), gains(1, 0), gains(2, 0));
+	}
+
+	size_t center=((size_t)(height/2)*width+width/2)*3;
+	printf("RGB[%u][%u]=%i %i %i\n", height/2, width/2, image[center], image[center+1], image[center+2]);
+
+	if(converter.Process(plane.data(), image.data(), range, height, width, 0, 32)==STATUS_OK ||
+		converter.ProcessPreview(plane.data(), image.data(), range, height, width, 1, 0, 17)==STATUS_OK)
+	{
+		std::cout << "Input bits wider than the samples accepted" << std::endl;
+		return 1;
+	}
+
+	// the same rows streamed through the row callbacks (the height is not a multiple of the strip height);
+	// the stream has no frame to estimate white balance from
+	unsigned int stream_height=height-6;
+	std::vector<unsigned char> streamed((size_t)width*stream_height*3);
+	size_t next_row=0;
+
+	converter.settings.white_balance_mode=WhiteBalanceNone;
+
+	auto read=[&](unsigned short* rows, size_t count)
+	{
+		size_t available=stream_height-next_row<count ? stream_height-next_row : count;
+		memcpy(rows, plane.data()+next_row*width, available*width*sizeof(unsigned short));
+		next_row+=available;
+		return available;
+	};
+
+	auto write=[&](const unsigned char* rows, size_t first_row, size_t count)
+	{
+		memcpy(streamed.data()+first_row*width*3, rows, count*width*3);
+	};
+
+	if(converter.ProcessStream(read, write, range, width, 0)!=STATUS_OK ||
+		converter.Process(plane.data(), image.data(), range, stream_height, width, 0)!=STATUS_OK ||
+		memcmp(streamed.data(), image.data(), streamed.size())!=0)
+	{
+		std::cout << "ProcessStream differs from Process" << std::endl;
+		return 1;
+	}
+
+	printf("Stream of %u rows matches Process\n", stream_height);
+	converter.settings.white_balance_mode=WhiteBalancePercentile;
+
+	// quarter size thumbnail: 2x2 quads binned, then 2x2 blocks of them averaged
+	unsigned int preview_width=converter.GetPreviewSize(width, 1);
+	unsigned int preview_height=converter.GetPreviewSize(height, 1);
+	std::vector<unsigned char> preview((size_t)preview_width*preview_height*3);
+
+	if(converter.ProcessPreview(file, preview.data(), range, 1, 0)==STATUS_OK)
+	{
+		size_t middle=((size_t)(preview_height/2)*preview_width+preview_width/2)*3;
+		printf("Preview %ux%u RGB=%i %i %i\n", preview_width, preview_height, preview[middle], preview[middle+1], preview[middle+2]);
+	}
+
+	return 0;
+}
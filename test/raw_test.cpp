@@ -21,7 +21,7 @@ int main(int arg_count, char* arg_value[])
 		if (arg_count > 1)
 		{
 			processing_state = 1;
-			LibRAW_Result = RawConverter.open_file(arg[1]);
+			LibRAW_Result = RawConverter.open_file(arg_value[1]);
 			if (LibRAW_Result == LIBRAW_SUCCESS)
 			{
 				processing_state = 2;
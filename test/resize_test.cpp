@@ -0,0 +1,40 @@
+#define __use__resize__
+
+#include <stdio.h>
+#include <vector>
+#include "../maxssau/maxssau.h"
+
+using namespace maxssau;
+
+int main(int arg_count,char* arg_values[])
+{
+	size_t width=640;
+	size_t height=480;
+	std::vector<unsigned short> image(width*height*3);
+
+	for(size_t y=0;y<height;y++)
+	{
+		for(size_t x=0;x<width;x++)
+		{
+			image[(y*width+x)*3+0]=(unsigned short)(x*64);
+			image[(y*width+x)*3+1]=(unsigned short)(y*64);
+			image[(y*width+x)*3+2]=32768;
+		}
+	}
+
+	// 16-bit input to 8-bit output: 255/65535 scale, expected about x*64/257, y*64/257, 128
+	ImageResizer<unsigned short,unsigned char> preview(width,height,160,120,3,ResizeLanczos3,255.0f/65535.0f);
+	std::vector<unsigned char> small;
+	preview.resize(image,small,0);
+
+	printf("Preview[60][80]=%i %i %i (expected %i %i %i)\n",small[(60*160+80)*3+0],small[(60*160+80)*3+1],small[(60*160+80)*3+2],
+		(int)((80*4+1.5)*64/257.0+0.5),(int)((60*4+1.5)*64/257.0+0.5),128);
+
+	ImageResizer<unsigned short,float> upscale(width,height,1280,960,3,ResizeCatmullRom);
+	std::vector<float> large;
+	upscale.resize(image,large,0);
+
+	printf("Upscale[480][640]=%f %f %f\n",large[(480*1280+640)*3+0],large[(480*1280+640)*3+1],large[(480*1280+640)*3+2]);
+
+	return 0;
+}
@@ -0,0 +1,42 @@
+#define __use__spline__fit__
+
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+#include "../maxssau/maxssau.h"
+
+using namespace maxssau;
+
+int main(int arg_count,char* arg_values[])
+{
+	// Noisy sensor response
+	size_t count=1000000;
+	std::vector<double> x(count);
+	std::vector<double> y(count);
+
+	srand(1);
+
+	for(size_t i=0;i<count;i++)
+	{
+		x[i]=10.0*rand()/RAND_MAX;
+		y[i]=sin(x[i])+0.2*((double)rand()/RAND_MAX-0.5);
+	}
+
+	CubicInterpolator<double> compact=fitLeastSquaresSpline(x,y,32,0.0,std::vector<double>(),0);
+	printf("Least squares f(1.1)=%f sin(1.1)=%f\n",compact.interpolate(1.1),sin(1.1));
+
+	std::vector<double> sx(2000);
+	std::vector<double> sy(2000);
+
+	for(size_t i=0;i<sx.size();i++)
+	{
+		sx[i]=i*0.005;
+		sy[i]=sin(sx[i])+0.2*((double)rand()/RAND_MAX-0.5);
+	}
+
+	CubicInterpolator<double> smooth=fitSmoothingSpline(sx,sy,0.01);
+	printf("Smoothing f(1.1)=%f sin(1.1)=%f\n",smooth.interpolate(1.1),sin(1.1));
+
+	return 0;
+}
@@ -0,0 +1,32 @@
+#define __use__statistics__
+
+#include <stdio.h>
+#include <vector>
+#include "../maxssau/maxssau.h"
+
+using namespace maxssau;
+
+int main(int arg_count,char* arg_values[])
+{
+    std::vector<unsigned short> frame(1 << 20);
+
+    for(size_t i=0;i<frame.size();i++)
+    {
+        frame[i]=(unsigned short)((i*7919)%4096);
+    }
+
+    Statistics<unsigned short> stat(true);
+    stat.Calculate(frame,0);
+
+    printf("Count=%llu\n",(unsigned long long)stat.GetCount());
+    printf("Min=%i\n",stat.GetMinValue());
+    printf("Max=%i\n",stat.GetMaxValue());
+    printf("Mean=%f\n",stat.GetMean());
+    printf("StdDev=%f\n",stat.GetStandardDeviation());
+    printf("Skewness=%f\n",stat.GetSkewness());
+    printf("Kurtosis=%f\n",stat.GetKurtosis());
+    printf("Median=%f\n",stat.GetQuantile(0.5));
+    printf("P99=%f\n",stat.GetPercentile(99.0));
+
+    return 0;
+}